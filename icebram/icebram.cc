@@ -26,8 +26,12 @@
 #include <vector>
 #include <string>
 #include <fstream>
+#include <sstream>
+#include <iterator>
 #include <iostream>
 
+#include "../icepack/icepack.h"
+
 using std::map;
 using std::pair;
 using std::vector;
@@ -94,7 +98,8 @@ void help(const char *cmd)
 	printf("\n");
 	printf("Replace BRAM initialization data in a .asc file. This can be used\n");
 	printf("for example to replace firmware images without re-running synthesis\n");
-	printf("and place&route.\n");
+	printf("and place&route. Binary config files written by 'icepack -C' are\n");
+	printf("accepted as well and are written back in the same format.\n");
 	printf("\n");
 	printf("    -g\n");
 	printf("        generate a hex file with random contents.\n");
@@ -273,24 +278,61 @@ int main(int argc, char **argv)
 
 
 	// -------------------------------------------------------
-	// Read ascfile from stdin
+	// Read ascfile (or binary config file) from stdin
 
 	vector<string> ascfile_lines;
 	map<string, vector<vector<bool>>> ascfile_hexdata;
 
-	for (int i = 1; getline(std::cin, line); i++)
+	string input((std::istreambuf_iterator<char>(std::cin)), std::istreambuf_iterator<char>());
+	bool binary_input = FpgaConfig::is_binary(input.data(), input.size());
+
+	FpgaConfig fpga;
+	map<string, pair<int, int>> ramb_tiles;
+
+	if (binary_input)
 	{
-	next_asc_stmt:
-		ascfile_lines.push_back(line);
+		fpga.read_binary((const uint8_t*)input.data(), input.size());
 
-		if (line.substr(0, 9) == ".ram_data")
+		// same layout as the .ram_data sections in the .asc file
+		for (int tile_y = 0; tile_y <= fpga.chip_height()+1 && !fpga.bram.empty(); tile_y++)
+		for (int tile_x = 0; tile_x <= fpga.chip_width()+1; tile_x++)
 		{
-			auto &hexdata = ascfile_hexdata[line];
+			if (fpga.geometry().tile_type(tile_x, tile_y) != TILE_RAMB)
+				continue;
+
+			string key = ".ram_data " + std::to_string(tile_x) + " " + std::to_string(tile_y);
+			auto &hexdata = ascfile_hexdata[key];
+			ramb_tiles[key] = pair<int, int>(tile_x, tile_y);
 
-			for (; getline(std::cin, line); i++) {
-				if (line.substr(0, 1) == ".")
-					goto next_asc_stmt;
-				parse_hexfile_line("stdin", i, hexdata, line);
+			BramIndexConverter bic(&fpga, tile_x, tile_y);
+			hexdata.assign(16, vector<bool>(256));
+
+			for (int bit_y = 0; bit_y < 16; bit_y++)
+			for (int bit_x = 0; bit_x < 256; bit_x++) {
+				int bram_bank, bram_x, bram_y;
+				bic.get_bram_index(bit_x, bit_y, bram_bank, bram_x, bram_y);
+				hexdata[bit_y][bit_x] = fpga.bram[bram_bank].get(bram_x, bram_y);
+			}
+		}
+	}
+	else
+	{
+		std::istringstream asc_in(input);
+
+		for (int i = 1; getline(asc_in, line); i++)
+		{
+		next_asc_stmt:
+			ascfile_lines.push_back(line);
+
+			if (line.substr(0, 9) == ".ram_data")
+			{
+				auto &hexdata = ascfile_hexdata[line];
+
+				for (; getline(asc_in, line); i++) {
+					if (line.substr(0, 1) == ".")
+						goto next_asc_stmt;
+					parse_hexfile_line("stdin", i, hexdata, line);
+				}
 			}
 		}
 	}
@@ -341,6 +383,29 @@ int main(int argc, char **argv)
 		fprintf(stderr, "Found and replaced %d instances of the memory.\n", max_replace_cnt);
 
 
+	// -------------------------------------------------------
+	// Write binary config file to stdout
+
+	if (binary_input)
+	{
+		for (auto &it : ramb_tiles)
+		{
+			auto &hexdata = ascfile_hexdata.at(it.first);
+			BramIndexConverter bic(&fpga, it.second.first, it.second.second);
+
+			for (int bit_y = 0; bit_y < 16; bit_y++)
+			for (int bit_x = 0; bit_x < 256; bit_x++) {
+				int bram_bank, bram_x, bram_y;
+				bic.get_bram_index(bit_x, bit_y, bram_bank, bram_x, bram_y);
+				fpga.bram[bram_bank].set(bram_x, bram_y, hexdata[bit_y][bit_x]);
+			}
+		}
+
+		fpga.write_binary(std::cout);
+		return 0;
+	}
+
+
 	// -------------------------------------------------------
 	// Write ascfile to stdout
 
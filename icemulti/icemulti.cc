@@ -18,11 +18,15 @@
 #include <iostream>
 #include <cstdint>
 #include <memory>
+#include <vector>
+#include <iterator>
 
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "../icepack/crc16.h"
+
 #define log(...) fprintf(stderr, __VA_ARGS__);
 #define info(...) do { if (log_level > 0) fprintf(stderr, __VA_ARGS__); } while (0)
 #define error(...) do { fprintf(stderr, "Error: " __VA_ARGS__); exit(1); } while (0)
@@ -89,6 +93,7 @@ public:
     Image(const char *filename, bool name_files=false) : ifs(filename, std::ifstream::binary), image_name(filename), save_name (name_files) {}
 
     size_t size();
+    bool check_crc();
     void write(std::ostream &ofs, uint32_t &file_offset);
     void place(uint32_t o) { offs = o; }
     uint32_t offset() const { return offs; }
@@ -114,6 +119,82 @@ size_t Image::size()
     return length;
 }
 
+// Walk the command stream of the image and verify every CRC check command
+// in it. Images that can't be parsed are passed through unchecked.
+bool Image::check_crc()
+{
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    ifs.clear();
+    ifs.seekg (0, ifs.beg);
+
+    size_t pos = 0;
+    uint32_t preamble = 0;
+    while (pos < data.size() && preamble != 0x7EAA997E)
+        preamble = (preamble << 8) | data[pos++];
+
+    if (preamble != 0x7EAA997E) {
+        info("No preamble found in %s, not checking CRC.\n", get_name());
+        return true;
+    }
+
+    size_t crc_start = 0;
+    uint16_t crc_init = 0;
+    int width = 0, height = 0;
+
+    while (pos < data.size())
+    {
+        uint8_t command = data[pos++];
+        uint32_t payload = 0;
+
+        for (int i = 0; i < (command & 0x0f) && pos < data.size(); i++)
+            payload = (payload << 8) | data[pos++];
+
+        switch (command & 0xf0)
+        {
+        case 0x00:
+            if (payload == 0x01 || payload == 0x03) {
+                pos += width * height / 8 + 2;
+            } else if (payload == 0x05) {
+                crc_start = pos;
+                crc_init = 0xffff;
+            } else {
+                // wakeup, reboot, ..
+                return true;
+            }
+            break;
+
+        case 0x20:
+            if (crc16(crc_init, data.data() + crc_start, pos - crc_start) != 0)
+                return false;
+            info("CRC Check OK for %s.\n", get_name());
+            crc_start = pos;
+            crc_init = 0;
+            break;
+
+        case 0x60:
+            width = payload + 1;
+            break;
+
+        case 0x70:
+            height = payload;
+            break;
+
+        case 0x10:
+        case 0x40:
+        case 0x50:
+        case 0x80:
+        case 0x90:
+            break;
+
+        default:
+            info("Unknown command 0x%02x in %s, not checking CRC.\n", command, get_name());
+            return true;
+        }
+    }
+
+    return true;
+}
+
 void Image::write(std::ostream &ofs, uint32_t &file_offset)
 {
 	if (save_name) {
@@ -283,6 +364,10 @@ int main(int argc, char **argv)
     if (por_image >= image_count)
         error("Specified non-existing image for power on reset\n");
 
+    for (int i=0; i<image_count; i++)
+        if (!images[i]->check_crc())
+            error("CRC check failed for image %s.\n", images[i]->get_name());
+
     // Place images
     uint32_t offs = NUM_HEADERS * HEADER_SIZE;
     if (align_first)
@@ -0,0 +1,214 @@
+//
+//  Copyright (C) 2015  Clifford Wolf <clifford@clifford.at>
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted, provided that the above
+//  copyright notice and this permission notice appear in all copies.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+//  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+//  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+//  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+//  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+//  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+//  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+#include "crc16.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#  define CRC16_PCLMUL
+#  include <immintrin.h>
+#endif
+
+uint16_t crc16_bitwise(uint16_t crc, const uint8_t *buf, size_t len)
+{
+	for (size_t k = 0; k < len; k++)
+	for (int i = 7; i >= 0; i--) {
+		uint16_t xor_value = ((crc >> 15) ^ ((buf[k] >> i) & 1)) ? 0x1021 : 0;
+		crc = (crc << 1) ^ xor_value;
+	}
+	return crc;
+}
+
+// table[0] is the usual byte-at-a-time table, table[k] is the CRC
+// contribution of a byte that is followed by k more bytes
+struct Crc16Tables
+{
+	uint16_t table[8][256];
+
+	Crc16Tables() {
+		for (int i = 0; i < 256; i++) {
+			uint8_t byte = i;
+			table[0][i] = crc16_bitwise(0, &byte, 1);
+		}
+		for (int k = 1; k < 8; k++)
+		for (int i = 0; i < 256; i++)
+			table[k][i] = (table[k-1][i] << 8) ^ table[0][table[k-1][i] >> 8];
+	}
+};
+
+static const Crc16Tables &crc16_tables()
+{
+	static const Crc16Tables tables;
+	return tables;
+}
+
+uint16_t crc16_table(uint16_t crc, const uint8_t *buf, size_t len)
+{
+	const uint16_t *t0 = crc16_tables().table[0];
+	for (size_t k = 0; k < len; k++)
+		crc = (crc << 8) ^ t0[(crc >> 8) ^ buf[k]];
+	return crc;
+}
+
+uint16_t crc16_slice8(uint16_t crc, const uint8_t *buf, size_t len)
+{
+	const Crc16Tables &t = crc16_tables();
+
+	for (; len >= 8; buf += 8, len -= 8)
+		crc = t.table[7][buf[0] ^ (crc >> 8)] ^ t.table[6][buf[1] ^ (crc & 0xff)] ^
+				t.table[5][buf[2]] ^ t.table[4][buf[3]] ^ t.table[3][buf[4]] ^
+				t.table[2][buf[5]] ^ t.table[1][buf[6]] ^ t.table[0][buf[7]];
+
+	return crc16_table(crc, buf, len);
+}
+
+#ifdef CRC16_PCLMUL
+
+// x^n mod P(x), P(x) = x^16 + x^12 + x^5 + 1
+static uint64_t crc16_xpow(int n)
+{
+	uint32_t value = 1;
+	for (int i = 0; i < n; i++) {
+		value <<= 1;
+		if (value & 0x10000)
+			value ^= 0x11021;
+	}
+	return value;
+}
+
+static inline void store_be64(uint8_t *p, uint64_t value)
+{
+	for (int i = 7; i >= 0; i--, value >>= 8)
+		p[i] = value;
+}
+
+bool crc16_have_pclmul()
+{
+	static const bool have_pclmul = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3");
+	return have_pclmul;
+}
+
+#define CRC16_TARGET __attribute__((target("pclmul,ssse3")))
+
+// load 16 bytes as a 128 bit polynomial, first byte in the most significant bits
+CRC16_TARGET static inline __m128i load_be128(const uint8_t *p)
+{
+	const __m128i reverse = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	return _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), reverse);
+}
+
+// acc * x^n, reduced to 128 bits. k holds (x^(n+64) mod P, x^n mod P).
+CRC16_TARGET static inline __m128i fold128(__m128i acc, __m128i k)
+{
+	return _mm_xor_si128(_mm_clmulepi64_si128(acc, k, 0x11), _mm_clmulepi64_si128(acc, k, 0x00));
+}
+
+// Fold the message 128 bits at a time: with the accumulator A = H*x^64 + L,
+// A*x^128 is congruent to H*(x^192 mod P) + L*(x^128 mod P), which fits in
+// 128 bits again. The main loop keeps four independent accumulators 512 bits
+// apart to hide the multiplier latency. The final accumulator is turned into
+// the CRC with the lookup tables, as are the tail bytes.
+CRC16_TARGET uint16_t crc16_pclmul(uint16_t crc, const uint8_t *buf, size_t len)
+{
+	if (len < 64)
+		return crc16_slice8(crc, buf, len);
+
+	static const __m128i k128 = _mm_set_epi64x(crc16_xpow(192), crc16_xpow(128));
+	static const __m128i k512 = _mm_set_epi64x(crc16_xpow(576), crc16_xpow(512));
+
+	__m128i acc0 = _mm_xor_si128(load_be128(buf), _mm_set_epi64x(uint64_t(crc) << 48, 0));
+	__m128i acc1 = load_be128(buf + 16);
+	__m128i acc2 = load_be128(buf + 32);
+	__m128i acc3 = load_be128(buf + 48);
+	buf += 64, len -= 64;
+
+	for (; len >= 64; buf += 64, len -= 64) {
+		acc0 = _mm_xor_si128(fold128(acc0, k512), load_be128(buf));
+		acc1 = _mm_xor_si128(fold128(acc1, k512), load_be128(buf + 16));
+		acc2 = _mm_xor_si128(fold128(acc2, k512), load_be128(buf + 32));
+		acc3 = _mm_xor_si128(fold128(acc3, k512), load_be128(buf + 48));
+	}
+
+	__m128i acc = _mm_xor_si128(fold128(acc0, k128), acc1);
+	acc = _mm_xor_si128(fold128(acc, k128), acc2);
+	acc = _mm_xor_si128(fold128(acc, k128), acc3);
+
+	for (; len >= 16; buf += 16, len -= 16)
+		acc = _mm_xor_si128(fold128(acc, k128), load_be128(buf));
+
+	uint64_t acc_words[2];
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(acc_words), acc);
+
+	uint8_t folded[16];
+	store_be64(folded, acc_words[1]);
+	store_be64(folded + 8, acc_words[0]);
+
+	crc = crc16_slice8(0, folded, 16);
+	return crc16_slice8(crc, buf, len);
+}
+
+#else
+
+bool crc16_have_pclmul()
+{
+	return false;
+}
+
+uint16_t crc16_pclmul(uint16_t crc, const uint8_t *buf, size_t len)
+{
+	return crc16_slice8(crc, buf, len);
+}
+
+#endif
+
+// a * b mod P(x)
+static uint16_t crc16_mulmod(uint16_t a, uint16_t b)
+{
+	uint16_t product = 0;
+	for (int i = 15; i >= 0; i--) {
+		product = (product << 1) ^ ((product & 0x8000) ? 0x1021 : 0);
+		if ((b >> i) & 1)
+			product ^= a;
+	}
+	return product;
+}
+
+uint16_t crc16_shift(uint16_t crc, size_t len)
+{
+	// x^(8 * 2^i) mod P
+	static const struct XPowTable {
+		uint16_t xpow[64];
+		XPowTable() {
+			uint16_t x8 = 0x0100;
+			for (int i = 0; i < 64; i++, x8 = crc16_mulmod(x8, x8))
+				xpow[i] = x8;
+		}
+	} table;
+
+	for (int i = 0; len; i++, len >>= 1)
+		if (len & 1)
+			crc = crc16_mulmod(crc, table.xpow[i]);
+
+	return crc;
+}
+
+// The intrinsics in crc16_pclmul() are only faster than the tables when
+// they are inlined, so every Makefile that builds this file adds -O2.
+uint16_t crc16(uint16_t crc, const uint8_t *buf, size_t len)
+{
+	if (len >= 64 && crc16_have_pclmul())
+		return crc16_pclmul(crc, buf, len);
+	return crc16_slice8(crc, buf, len);
+}
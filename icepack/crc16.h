@@ -0,0 +1,47 @@
+//
+//  Copyright (C) 2015  Clifford Wolf <clifford@clifford.at>
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted, provided that the above
+//  copyright notice and this permission notice appear in all copies.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+//  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+//  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+//  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+//  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+//  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+//  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+#ifndef CRC16_H
+#define CRC16_H
+
+#include <cstddef>
+#include <cstdint>
+
+// CRC-16-CCITT as used by the iCE40 bitstream: polynomial 0x1021, MSB
+// first, no reflection and no final xor. The bitstream resets the CRC to
+// 0xFFFF with command 0x01 0x05.
+//
+// All functions continue the CRC 'crc' over 'len' bytes of 'buf' and
+// return the new CRC value, so a long message can be processed in pieces.
+
+// best implementation available on the running CPU
+uint16_t crc16(uint16_t crc, const uint8_t *buf, size_t len);
+
+// same as crc16() over len zero bytes, in O(log len) time. as the CRC is
+// linear, crc16_shift(crc16(0, D, 1), n) is the change of the CRC after n
+// more bytes when a byte of the message is xor'ed with D.
+uint16_t crc16_shift(uint16_t crc, size_t len);
+
+// the individual implementations (for testing and benchmarking)
+uint16_t crc16_bitwise(uint16_t crc, const uint8_t *buf, size_t len);
+uint16_t crc16_table(uint16_t crc, const uint8_t *buf, size_t len);
+uint16_t crc16_slice8(uint16_t crc, const uint8_t *buf, size_t len);
+
+// only valid when crc16_have_pclmul() returns true
+bool crc16_have_pclmul();
+uint16_t crc16_pclmul(uint16_t crc, const uint8_t *buf, size_t len);
+
+#endif
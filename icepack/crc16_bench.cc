@@ -0,0 +1,79 @@
+//
+//  Copyright (C) 2015  Clifford Wolf <clifford@clifford.at>
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted, provided that the above
+//  copyright notice and this permission notice appear in all copies.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+//  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+//  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+//  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+//  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+//  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+//  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+// Microbenchmark for the CRC-16 implementations in crc16.cc
+//
+// Usage: crc16_bench [size-in-bytes [iterations]]
+//
+// The default size is that of an 8k bitstream.
+
+#include <vector>
+#include <chrono>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "crc16.h"
+
+typedef uint16_t (*crc16_func_t)(uint16_t crc, const uint8_t *buf, size_t len);
+
+static void bench(const char *name, crc16_func_t func, const std::vector<uint8_t> &data, int iterations, uint16_t expected)
+{
+	uint16_t crc = func(0xffff, data.data(), data.size());
+
+	if (crc != expected) {
+		printf("%-8s  MISMATCH: 0x%04x, expected 0x%04x\n", name, crc, expected);
+		exit(1);
+	}
+
+	auto t0 = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++)
+		crc = func(crc, data.data(), data.size());
+	auto t1 = std::chrono::steady_clock::now();
+
+	double seconds = std::chrono::duration<double>(t1 - t0).count();
+	double bytes = double(data.size()) * iterations;
+
+	printf("%-8s  %10.1f MB/s  %8.3f ns/byte  (crc 0x%04x)\n", name,
+			bytes / seconds * 1e-6, seconds * 1e9 / bytes, crc);
+}
+
+int main(int argc, char **argv)
+{
+	int size = argc > 1 ? atoi(argv[1]) : 135100;
+	int iterations = argc > 2 ? atoi(argv[2]) : 200;
+
+	std::vector<uint8_t> data(size);
+	uint32_t state = 1;
+	for (auto &byte : data) {
+		state = state * 1103515245 + 12345;
+		byte = state >> 16;
+	}
+
+	uint16_t expected = crc16_bitwise(0xffff, data.data(), data.size());
+	printf("%d bytes, %d iterations\n", size, iterations);
+
+	bench("bitwise", crc16_bitwise, data, iterations, expected);
+	bench("table", crc16_table, data, iterations, expected);
+	bench("slice8", crc16_slice8, data, iterations, expected);
+	if (crc16_have_pclmul())
+		bench("pclmul", crc16_pclmul, data, iterations, expected);
+	else
+		printf("pclmul    not supported on this CPU\n");
+	bench("crc16", crc16, data, iterations, expected);
+
+	return 0;
+}
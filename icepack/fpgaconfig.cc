@@ -0,0 +1,2158 @@
+//
+//  Copyright (C) 2015  Clifford Wolf <clifford@clifford.at>
+//
+//  Based on a reference implementation provided by Mathias Lasser
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted, provided that the above
+//  copyright notice and this permission notice appear in all copies.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+//  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+//  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+//  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+//  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+//  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+//  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <algorithm>
+#include <sstream>
+#include <cstdint>
+#include <cstring>
+
+#include <stdio.h>
+#include <ctype.h>
+#include <limits.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "icepack.h"
+#include "util.h"
+#include "crc16.h"
+#include "tilekernels.h"
+
+using std::vector;
+using std::string;
+
+// ==================================================================
+// FpgaConfig stuff
+
+static inline void copy_bit(uint8_t *dst, int dst_off, const uint8_t *src, int src_off)
+{
+	uint8_t mask = 0x80 >> (dst_off & 7);
+	if (src[src_off >> 3] & (0x80 >> (src_off & 7)))
+		dst[dst_off >> 3] |= mask;
+	else
+		dst[dst_off >> 3] &= ~mask;
+}
+
+// copy nbits from src (starting at bit src_off) to dst (starting at bit dst_off), MSB first.
+// dst may overlap src if it does not start after it.
+static void copy_bits(uint8_t *dst, int dst_off, const uint8_t *src, int src_off, int nbits)
+{
+	// single bits up to the next byte boundary in dst
+	for (; nbits > 0 && (dst_off & 7) != 0; nbits--, dst_off++, src_off++)
+		copy_bit(dst, dst_off, src, src_off);
+
+	// whole bytes, shifted together from two source bytes if src is not aligned
+	int nbytes = nbits >> 3, shift = src_off & 7;
+	uint8_t *d = dst + (dst_off >> 3);
+	const uint8_t *s = src + (src_off >> 3);
+
+	if (shift == 0)
+		memmove(d, s, nbytes);
+	else
+		for (int i = 0; i < nbytes; i++)
+			d[i] = (s[i] << shift) | (s[i+1] >> (8 - shift));
+
+	dst_off += nbits & ~7, src_off += nbits & ~7, nbits &= 7;
+
+	for (int i = 0; i < nbits; i++, dst_off++, src_off++)
+		copy_bit(dst, dst_off, src, src_off);
+}
+
+void BitPlane::resize(int width, int height)
+{
+	if (width == this->width && height >= this->height) {
+		this->height = height;
+		this->data.resize((width * height + 63) / 64 * 8);
+		return;
+	}
+
+	BitPlane old;
+	std::swap(old, *this);
+
+	this->width = width;
+	this->height = height;
+	this->data.assign((width * height + 63) / 64 * 8, 0);
+
+	for (int y = 0; y < std::min(height, old.height); y++)
+		copy_bits(this->data.data(), y * width, old.data.data(), y * old.width, std::min(width, old.width));
+}
+
+void BitPlane::clear()
+{
+	std::fill(this->data.begin(), this->data.end(), 0);
+}
+
+void BitPlane::load_rows(int y, int num_rows, const uint8_t *src)
+{
+	copy_bits(this->data.data(), y * this->width, src, 0, num_rows * this->width);
+}
+
+void BitPlane::store_rows(int y, int num_rows, uint8_t *dst) const
+{
+	copy_bits(dst, 0, this->data.data(), y * this->width, num_rows * this->width);
+}
+
+DeviceGeometry::DeviceGeometry(const string &name, int chip_width, int chip_height, int cram_width, int cram_height,
+		int bram_width, int bram_height, const vector<int> &cols, const vector<int> &ram_cols) :
+		name(name), chip_width(chip_width), chip_height(chip_height), cram_width(cram_width), cram_height(cram_height),
+		bram_width(bram_width), bram_height(bram_height), cols(cols), ram_cols(ram_cols)
+{
+	this->col_offset.push_back(0);
+	for (int width : cols)
+		this->col_offset.push_back(this->col_offset.back() + width);
+
+	for (int y = 0; y <= chip_height+1; y++)
+	for (int x = 0; x <= chip_width+1; x++)
+	{
+		bool x_edge = x == 0 || x == chip_width+1;
+		bool y_edge = y == 0 || y == chip_height+1;
+
+		TileType type = TILE_LOGIC;
+		if (x_edge && y_edge)
+			type = TILE_CORNER;
+		else if (x_edge || y_edge)
+			type = TILE_IO;
+		else if (std::find(ram_cols.begin(), ram_cols.end(), x) != ram_cols.end())
+			type = y % 2 == 1 ? TILE_RAMB : TILE_RAMT;
+
+		this->tile_types.push_back(type);
+	}
+}
+
+// All supported device types. Everything else (bitstream and .asc device
+// detection, the index tables, ..) is derived from this list.
+static const vector<DeviceGeometry> &device_geometries()
+{
+	static const vector<DeviceGeometry> geometries = {
+		//             name   chip    cram      bram      cram columns                                                           ram columns
+		DeviceGeometry("384",  6,  8, 182,  80,   0,   0, {18, 54, 54, 54, 54},                                                  {}),
+		DeviceGeometry("1k",  12, 16, 332, 144,  64, 256, {18, 54, 54, 42, 54, 54, 54},                                          {3, 10}),
+		DeviceGeometry("8k",  32, 32, 872, 272, 128, 256, {18, 54, 54, 54, 54, 54, 54, 54, 42, 54, 54, 54, 54, 54, 54, 54, 54},  {8, 25}),
+	};
+	return geometries;
+}
+
+const DeviceGeometry *DeviceGeometry::find(const string &device)
+{
+	for (auto &geom : device_geometries())
+		if (geom.name == device)
+			return &geom;
+	return nullptr;
+}
+
+// bank sizes of a device type, false for unknown devices
+static bool device_bank_sizes(const string &device, int &cram_width, int &cram_height, int &bram_width, int &bram_height)
+{
+	const DeviceGeometry *geom = DeviceGeometry::find(device);
+	if (geom == nullptr)
+		return false;
+
+	cram_width = geom->cram_width;
+	cram_height = geom->cram_height;
+	bram_width = geom->bram_width;
+	bram_height = geom->bram_height;
+	return true;
+}
+
+// device type with the given cram bank width (and height, unless it is -1), or ""
+static string device_from_cram_size(int width, int height = -1)
+{
+	for (auto &geom : device_geometries())
+		if (geom.cram_width == width && (height < 0 || geom.cram_height == height))
+			return geom.name;
+	return "";
+}
+
+// bank data is passed on in blocks of up to this many bytes (plus one row)
+static const int bank_data_block_size = 4096;
+
+void BitstreamDecoder::push(const uint8_t *data, size_t len)
+{
+	const uint8_t *end = data + len;
+	stat_add(COUNTER_BYTES_DECODED, len);
+
+	while (data < end && this->state != DONE)
+	{
+		if (this->state == PREAMBLE)
+		{
+			// skip initial comments until preamble is found
+			ScopedTimer timer(TIMER_PREAMBLE);
+			const uint8_t *start = data;
+			bool found = false;
+
+			while (data < end && !found) {
+				uint8_t byte = *data++;
+				this->preamble = (this->preamble << 8) | byte;
+				if (this->preamble == 0xffffffff)
+					error("No preamble found in bitstream.\n");
+				if (this->preamble == 0x7EAA997E)
+					found = true;
+				else
+					this->initblop.push_back(byte);
+			}
+
+			this->crc_value = crc16(this->crc_value, start, data - start);
+			this->file_offset += data - start;
+
+			if (found) {
+				info("Found preamble at offset %d.\n", this->file_offset-4);
+				this->initblop.resize(this->initblop.size() - 3);
+				this->state = COMMAND;
+				on_preamble();
+			}
+			continue;
+		}
+
+		if (this->state == BANK_DATA)
+		{
+			int n = std::min<size_t>(end - data, this->data_bytes_left);
+			{
+				ScopedTimer timer(TIMER_CRC);
+				this->crc_value = crc16(this->crc_value, data, n);
+			}
+			this->file_offset += n;
+			if (this->skip_bank_data) {
+				this->data_bytes_left -= n;
+			} else {
+				ScopedTimer timer(TIMER_BANK_DATA);
+				push_bank_data(data, n);
+			}
+			data += n;
+
+			if (this->data_bytes_left == 0) {
+				if (!this->skip_bank_data)
+					flush_rows(true);
+				this->state = END_TOKEN;
+				this->payload = 0;
+				this->payload_bytes = 0;
+			}
+			continue;
+		}
+
+		uint8_t byte = *data++;
+		this->crc_value = crc16(this->crc_value, &byte, 1);
+		this->file_offset++;
+
+		switch (this->state)
+		{
+		case COMMAND:
+			// one command byte. the lower 4 bits of the command byte specify
+			// the length of the command payload.
+			this->command = byte;
+			this->payload = 0;
+			this->payload_bytes = byte & 0x0f;
+			if (this->payload_bytes == 0)
+				execute_command();
+			else
+				this->state = PAYLOAD;
+			break;
+
+		case PAYLOAD:
+			this->payload = (this->payload << 8) | byte;
+			if (--this->payload_bytes == 0)
+				execute_command();
+			break;
+
+		case END_TOKEN:
+			this->payload = (this->payload << 8) | byte;
+			if (++this->payload_bytes == 2) {
+				if (this->payload)
+					error("Expeded 0x0000 after %s data, got 0x%04x\n", this->data_bram ? "BRAM" : "CRAM", this->payload);
+				this->state = COMMAND;
+			}
+			break;
+
+		default:
+			error("Invalid decoder state %d.\n", int(this->state));
+		}
+	}
+}
+
+void BitstreamDecoder::execute_command()
+{
+	debug("Next command at offset %d: 0x%02x 0x%0*x\n", this->file_offset - 1 - (this->command & 0x0f),
+			this->command, 2*(this->command & 0x0f), this->payload);
+
+	this->state = COMMAND;
+
+	switch (this->command & 0xf0)
+	{
+	case 0x00:
+		switch (this->payload)
+		{
+		case 0x01:
+		case 0x03:
+			this->data_bram = this->payload == 0x03;
+
+			info("%s Data [%d]: %d x %d bits = %d bits = %d bytes\n", this->data_bram ? "BRAM" : "CRAM",
+					this->current_bank, this->current_width, this->current_height,
+					this->current_height*this->current_width, (this->current_height*this->current_width)/8);
+
+			if (this->current_bank < 0 || this->current_bank > 3)
+				error("Invalid bank number %d.\n", this->current_bank);
+
+			if (!this->data_bram && this->device.empty()) {
+				this->device = device_from_cram_size(this->current_width);
+				if (!this->device.empty()) {
+					info("Chip type is probably '%s'.\n", this->device.c_str());
+					on_device();
+				}
+			}
+
+			on_bank_begin(this->data_bram, this->current_bank, this->current_width, this->current_height, this->current_offset);
+
+			this->data_bytes_left = (this->current_height*this->current_width)/8;
+			this->data_rows_done = 0;
+			this->row_bits = 0;
+			this->row_buffer.assign((this->current_width + 7) / 8 + bank_data_block_size + 1, 0);
+
+			this->state = this->data_bytes_left ? BANK_DATA : END_TOKEN;
+			this->payload = 0;
+			this->payload_bytes = 0;
+			break;
+
+		case 0x05:
+			debug("Resetting CRC.\n");
+			this->crc_value = 0xffff;
+			on_crc_reset();
+			break;
+
+		case 0x06:
+			info("Wakeup.\n");
+			this->state = DONE;
+			on_wakeup();
+			break;
+
+		default:
+			error("Unknown command: 0x%02x 0x%02x\n", this->command, this->payload);
+		}
+		break;
+
+	case 0x10:
+		this->current_bank = this->payload;
+		debug("Set bank to %d.\n", this->current_bank);
+		break;
+
+	case 0x20:
+		if (this->crc_value != 0)
+			error("CRC Check FAILED.\n");
+		info("CRC Check OK.\n");
+		on_crc_check();
+		break;
+
+	case 0x50:
+		if (this->payload == 0)
+			on_freqrange("low");
+		else if (this->payload == 1)
+			on_freqrange("medium");
+		else if (this->payload == 2)
+			on_freqrange("high");
+		else
+			error("Unknown freqrange payload 0x%02x\n", this->payload);
+		break;
+
+	case 0x60:
+		this->current_width = this->payload + 1;
+		debug("Setting bank width to %d.\n", this->current_width);
+		break;
+
+	case 0x70:
+		this->current_height = this->payload;
+		debug("Setting bank height to %d.\n", this->current_height);
+		break;
+
+	case 0x80:
+		this->current_offset = this->payload;
+		debug("Setting bank offset to %d.\n", this->current_offset);
+		break;
+
+	case 0x90:
+		if (this->payload == 0)
+			on_warmboot("disabled");
+		else if (this->payload == 32)
+			on_warmboot("enabled");
+		else
+			error("Unknown warmboot payload 0x%02x\n", this->payload);
+		break;
+
+	default:
+		error("Unknown command: 0x%02x 0x%02x\n", this->command, this->payload);
+	}
+}
+
+// append len bytes of bank data to the row buffer and pass on all complete rows
+void BitstreamDecoder::push_bank_data(const uint8_t *data, int len)
+{
+	while (len > 0)
+	{
+		int room = int(this->row_buffer.size()) - (this->row_bits + 7) / 8 - 1;
+		int n = std::min(len, room);
+
+		copy_bits(this->row_buffer.data(), this->row_bits, data, 0, 8*n);
+		this->row_bits += 8*n;
+		this->data_bytes_left -= n;
+		data += n, len -= n;
+
+		flush_rows(false);
+	}
+}
+
+// pass on the complete rows in the row buffer. at the end of the bank data a
+// final partial row (only if width*height is not a multiple of 8) is padded with zeros.
+void BitstreamDecoder::flush_rows(bool last)
+{
+	int width = this->current_width;
+	if (width == 0)
+		return;
+
+	if (last && this->row_bits % width != 0) {
+		for (int i = this->row_bits; i % width != 0; i++)
+			this->row_buffer[i >> 3] &= ~(0x80 >> (i & 7));
+		this->row_bits += width - this->row_bits % width;
+	}
+
+	int num_rows = this->row_bits / width;
+	if (num_rows == 0)
+		return;
+
+	on_bank_rows(this->data_bram, this->current_bank, this->current_offset + this->data_rows_done,
+			num_rows, width, this->row_buffer.data());
+
+	int used = num_rows * width;
+	copy_bits(this->row_buffer.data(), 0, this->row_buffer.data(), used, this->row_bits - used);
+
+	this->data_rows_done += num_rows;
+	this->row_bits -= used;
+}
+
+// decoder that stores everything in an FpgaConfig. the banks are grown to
+// the largest size seen, and each bank must cover all of it in the end.
+struct FpgaConfigDecoder : BitstreamDecoder
+{
+	FpgaConfig *fpga;
+
+	// width and last row + 1 of the data loaded into each bank, 0 if none
+	int bank_width[2][4] = {};
+	int bank_end[2][4] = {};
+
+	FpgaConfigDecoder(FpgaConfig *fpga) : fpga(fpga)
+	{
+		// start with empty banks, rows that are not loaded must be zero
+		this->fpga->cram_width = 0;
+		this->fpga->cram_height = 0;
+		this->fpga->cram.clear();
+
+		this->fpga->bram_width = 0;
+		this->fpga->bram_height = 0;
+		this->fpga->bram.clear();
+	}
+
+	void on_preamble() override {
+		this->fpga->initblop = this->initblop;
+	}
+
+	void on_bank_begin(bool bram, int bank, int width, int height, int offset) override {
+		int &plane_width = bram ? this->fpga->bram_width : this->fpga->cram_width;
+		int &plane_height = bram ? this->fpga->bram_height : this->fpga->cram_height;
+		vector<BitPlane> &planes = bram ? this->fpga->bram : this->fpga->cram;
+
+		plane_width = std::max(plane_width, width);
+		plane_height = std::max(plane_height, offset + height);
+
+		planes.resize(4);
+		planes[bank].resize(plane_width, plane_height);
+
+		if (this->bank_width[bram][bank] != 0 && this->bank_width[bram][bank] != width)
+			error("%s bank %d is loaded with different widths.\n", bram ? "BRAM" : "CRAM", bank);
+		this->bank_width[bram][bank] = width;
+		this->bank_end[bram][bank] = std::max(this->bank_end[bram][bank], offset + height);
+	}
+
+	void on_bank_rows(bool bram, int bank, int y, int num_rows, int width, const uint8_t *rows) override {
+		BitPlane &plane = bram ? this->fpga->bram[bank] : this->fpga->cram[bank];
+
+		if (width == plane.width) {
+			plane.load_rows(y, num_rows, rows);
+			return;
+		}
+
+		for (int i = 0; i < num_rows; i++)
+			copy_bits(plane.data.data(), (y + i) * plane.width, rows, i * width, width);
+	}
+
+	void on_freqrange(const string &freqrange) override {
+		this->fpga->freqrange = freqrange;
+		info("Setting freqrange to '%s'.\n", freqrange.c_str());
+	}
+
+	void on_warmboot(const string &warmboot) override {
+		this->fpga->warmboot = warmboot;
+		info("Setting warmboot to '%s'.\n", warmboot.c_str());
+	}
+
+	// a bank that is narrower or ends before the others would be padded
+	// with zeros silently. missing banks are left to detect_device().
+	void on_wakeup() override {
+		for (int bram = 0; bram < 2; bram++)
+		for (int bank = 0; bank < 4; bank++) {
+			int width = bram ? this->fpga->bram_width : this->fpga->cram_width;
+			int height = bram ? this->fpga->bram_height : this->fpga->cram_height;
+			if (this->bank_width[bram][bank] == 0)
+				continue;
+			if (this->bank_width[bram][bank] != width || this->bank_end[bram][bank] != height)
+				error("%s bank %d is loaded as %dx%d, the other banks as %dx%d.\n", bram ? "BRAM" : "CRAM", bank,
+						this->bank_width[bram][bank], this->bank_end[bram][bank], width, height);
+		}
+	}
+};
+
+// set the device type from the cram bank size after reading a bitstream and
+// check that the banks have the size of the device, so that the writers can
+// rely on it. BRAM banks that were not loaded at all are left zero.
+static void detect_device(FpgaConfig *fpga)
+{
+	fpga->device = device_from_cram_size(fpga->cram_width, fpga->cram_height);
+	if (fpga->device.empty())
+		error("Failed to detect chip type.\n");
+
+	info("Chip type is '%s'.\n", fpga->device.c_str());
+
+	const DeviceGeometry &geom = fpga->geometry();
+
+	fpga->cram.resize(4);
+	for (int i = 0; i < 4; i++)
+		if (fpga->cram[i].width != geom.cram_width || fpga->cram[i].height != geom.cram_height)
+			error("CRAM bank %d has size %dx%d instead of %dx%d.\n", i, fpga->cram[i].width, fpga->cram[i].height,
+					geom.cram_width, geom.cram_height);
+
+	fpga->bram_width = geom.bram_width;
+	fpga->bram_height = geom.bram_height;
+
+	fpga->bram.resize(geom.bram_width && geom.bram_height ? 4 : 0);
+	for (int i = 0; i < int(fpga->bram.size()); i++) {
+		BitPlane &plane = fpga->bram[i];
+		if (plane.width == 0 && plane.height == 0)
+			plane.resize(geom.bram_width, geom.bram_height);
+		else if (plane.width != geom.bram_width || plane.height != geom.bram_height)
+			error("BRAM bank %d has size %dx%d instead of %dx%d.\n", i, plane.width, plane.height,
+					geom.bram_width, geom.bram_height);
+	}
+}
+
+void FpgaConfig::read_bits(std::istream &ifs)
+{
+	debug("## %s\n", __PRETTY_FUNCTION__);
+	info("Parsing bitstream file..\n");
+	ScopedTimer timer(TIMER_READ_BITS);
+
+	FpgaConfigDecoder decoder(this);
+	vector<char> buffer(65536);
+
+	while (!decoder.done())
+	{
+		ifs.read(buffer.data(), buffer.size());
+		if (ifs.gcount() == 0)
+			error("Unexpected end of file.\n");
+		decoder.push(reinterpret_cast<const uint8_t*>(buffer.data()), ifs.gcount());
+	}
+
+	detect_device(this);
+}
+
+void FpgaConfig::read_bits(const uint8_t *data, size_t len)
+{
+	debug("## %s\n", __PRETTY_FUNCTION__);
+	info("Parsing bitstream file..\n");
+	ScopedTimer timer(TIMER_READ_BITS);
+
+	FpgaConfigDecoder decoder(this);
+	decoder.push(data, len);
+
+	if (!decoder.done())
+		error("Unexpected end of file.\n");
+
+	detect_device(this);
+}
+
+
+// append a command byte and its payload. the lower 4 bits of the command
+// byte specify the length of the command payload.
+static void write_command(vector<uint8_t> &data, uint8_t command, uint32_t payload)
+{
+	data.push_back(command);
+	for (int i = (command & 0x0f) - 1; i >= 0; i--)
+		data.push_back(payload >> (8*i));
+}
+
+// append the packed rows [offset, offset+num_rows) of a bank as command payload
+static void write_bank_rows(vector<uint8_t> &data, const BitPlane &plane, int offset, int num_rows)
+{
+	size_t pos = data.size();
+	data.resize(pos + (plane.width * num_rows + 7) / 8);
+	plane.store_rows(offset, num_rows, data.data() + pos);
+}
+
+// With skip_zero_rows only the rows of a bank that contain set bits are
+// written, in blocks of at most max_rows rows with their own bank height and
+// offset. The rows that are left out stay cleared, as after the reset. Blocks
+// start and end at multiples of 'align' rows so that each block is a whole
+// number of bytes. The last block always ends at the last row, so that the
+// reader still sees the full bank size.
+static void write_nonzero_rows(vector<uint8_t> &data, const BitPlane &plane, bool bram, int max_rows, int &current_height)
+{
+	int align = 1;
+	while (plane.width * align % 8 != 0)
+		align++;
+
+	if (plane.height % align != 0)
+		error("Bank height %d is not a multiple of %d rows.\n", plane.height, align);
+
+	int group_bytes = plane.width * align / 8;
+	int num_groups = plane.height / align;
+
+	auto keep_group = [&](int group) {
+		if (group == num_groups-1)
+			return true;
+		const uint8_t *p = plane.data.data() + group * group_bytes;
+		return std::any_of(p, p + group_bytes, [](uint8_t byte) { return byte != 0; });
+	};
+
+	for (int group = 0; group < num_groups;)
+	{
+		if (!keep_group(group)) {
+			group++;
+			continue;
+		}
+
+		int first_group = group;
+		while (group < num_groups && (group - first_group + 1) * align <= max_rows && keep_group(group))
+			group++;
+
+		int offset = first_group * align, height = (group - first_group) * align;
+
+		if (height != current_height) {
+			debug("%s: Setting bank height to %d.\n", bram ? "BRAM" : "CRAM", height);
+			write_command(data, 0x72, height);
+			current_height = height;
+		}
+
+		debug("%s: Setting bank offset to %d.\n", bram ? "BRAM" : "CRAM", offset);
+		write_command(data, 0x82, offset);
+
+		debug("%s: Writing rows %d to %d.\n", bram ? "BRAM" : "CRAM", offset, offset + height - 1);
+		write_command(data, 0x01, bram ? 0x03 : 0x01);
+		write_bank_rows(data, plane, offset, height);
+		data.push_back(0x00);
+		data.push_back(0x00);
+	}
+}
+
+void FpgaConfig::write_bits(std::ostream &ofs, bool skip_zero_rows) const
+{
+	vector<uint8_t> data;
+	write_bits(data, skip_zero_rows);
+
+	ScopedTimer timer(TIMER_WRITE_OUTPUT);
+	ofs.write(reinterpret_cast<const char*>(data.data()), data.size());
+	stat_add(COUNTER_BYTES_WRITTEN, data.size());
+}
+
+void FpgaConfig::write_bits(vector<uint8_t> &data, bool skip_zero_rows) const
+{
+	debug("## %s\n", __PRETTY_FUNCTION__);
+	info("Writing bitstream file..\n");
+	ScopedTimer timer(TIMER_WRITE_BITS);
+
+	int bram_chunk_size = 128;
+
+	data.clear();
+	data.reserve(this->initblop.size() + 64 + 4 * (this->cram_width * this->cram_height / 8 + 8) +
+			4 * (this->bram_width * this->bram_height / 8 + 8 * (this->bram_height / bram_chunk_size + 1)));
+
+	data.insert(data.end(), this->initblop.begin(), this->initblop.end());
+
+	debug("Writing preamble.\n");
+	for (uint8_t byte : {0x7E, 0xAA, 0x99, 0x7E})
+		data.push_back(byte);
+
+	debug("Setting freqrange to '%s'.\n", this->freqrange.c_str());
+	if (this->freqrange == "low")
+		write_command(data, 0x51, 0x00);
+	else if (this->freqrange == "medium")
+		write_command(data, 0x51, 0x01);
+	else if (this->freqrange == "high")
+		write_command(data, 0x51, 0x02);
+	else
+		error("Unknown freqrange '%s'.\n", this->freqrange.c_str());
+
+	debug("Resetting CRC.\n");
+	write_command(data, 0x01, 0x05);
+	size_t crc_start = data.size();
+
+	debug("Setting warmboot to '%s'.\n", this->warmboot.c_str());
+	if (this->warmboot == "disabled")
+		write_command(data, 0x92, 0x0000);
+	else if (this->warmboot == "enabled")
+		write_command(data, 0x92, 0x0020);
+	else
+		error("Unknown warmboot setting '%s'.\n", this->warmboot.c_str());
+
+	debug("CRAM: Setting bank width to %d.\n", this->cram_width);
+	write_command(data, 0x62, this->cram_width-1);
+
+	int current_height = -1;
+
+	if (!skip_zero_rows) {
+		debug("CRAM: Setting bank height to %d.\n", this->cram_height);
+		write_command(data, 0x72, this->cram_height);
+
+		debug("CRAM: Setting bank offset to 0.\n");
+		write_command(data, 0x82, 0);
+	}
+
+	for (int cram_bank = 0; cram_bank < 4; cram_bank++)
+	{
+		debug("CRAM: Setting bank %d.\n", cram_bank);
+		write_command(data, 0x11, cram_bank);
+
+		if (skip_zero_rows) {
+			write_nonzero_rows(data, this->cram[cram_bank], false, this->cram_height, current_height);
+			continue;
+		}
+
+		debug("CRAM: Writing bank %d data.\n", cram_bank);
+		write_command(data, 0x01, 0x01);
+		write_bank_rows(data, this->cram[cram_bank], 0, this->cram_height);
+		data.push_back(0x00);
+		data.push_back(0x00);
+	}
+
+	if (this->bram_width && this->bram_height)
+	{
+		debug("BRAM: Setting bank width to %d.\n", this->bram_width);
+		write_command(data, 0x62, this->bram_width-1);
+
+		if (!skip_zero_rows) {
+			debug("BRAM: Setting bank height to %d.\n", this->bram_height);
+			write_command(data, 0x72, bram_chunk_size);
+		}
+
+		for (int bram_bank = 0; bram_bank < 4; bram_bank++)
+		{
+			debug("BRAM: Setting bank %d.\n", bram_bank);
+			write_command(data, 0x11, bram_bank);
+
+			if (skip_zero_rows) {
+				write_nonzero_rows(data, this->bram[bram_bank], true, bram_chunk_size, current_height);
+				continue;
+			}
+
+			for (int offset = 0; offset < this->bram_height; offset += bram_chunk_size)
+			{
+				debug("BRAM: Setting bank offset to %d.\n", offset);
+				write_command(data, 0x82, offset);
+
+				debug("BRAM: Writing bank %d data.\n", bram_bank);
+				write_command(data, 0x01, 0x03);
+				write_bank_rows(data, this->bram[bram_bank], offset, bram_chunk_size);
+				data.push_back(0x00);
+				data.push_back(0x00);
+			}
+		}
+	}
+
+	// the CRC covers the CRC command byte itself, so that the CRC over
+	// the complete command is zero
+	debug("Writing CRC value.\n");
+	data.push_back(0x22);
+	uint16_t crc_value;
+	{
+		ScopedTimer timer(TIMER_CRC);
+		crc_value = crc16(0xffff, data.data() + crc_start, data.size() - crc_start);
+	}
+	data.push_back(crc_value >> 8);
+	data.push_back(crc_value);
+
+	debug("Wakeup.\n");
+	write_command(data, 0x01, 0x06);
+
+	debug("Padding byte.\n");
+	data.push_back(0x00);
+}
+
+// positions of the bank data blocks, CRC resets and CRC checks in a bitstream
+struct BitstreamLayout : BitstreamDecoder
+{
+	struct Block {
+		bool bram;
+		int bank, width, height, offset;
+		int file_offset;
+	};
+
+	vector<Block> blocks;
+
+	// file offsets after the CRC reset commands and after the CRC values of the checks
+	vector<int> resets, checks;
+
+	BitstreamLayout() {
+		this->skip_bank_data = true;
+	}
+
+	void on_bank_begin(bool bram, int bank, int width, int height, int offset) override {
+		Block block = { bram, bank, width, height, offset, this->file_offset };
+		this->blocks.push_back(block);
+	}
+
+	void on_crc_reset() override {
+		this->resets.push_back(this->file_offset);
+	}
+
+	void on_crc_check() override {
+		this->checks.push_back(this->file_offset);
+	}
+};
+
+void patch_bitstream(vector<uint8_t> &data, const vector<BitEdit> &edits)
+{
+	debug("## %s\n", __PRETTY_FUNCTION__);
+	info("Patching bitstream..\n");
+
+	BitstreamLayout layout;
+	layout.push(data.data(), data.size());
+	if (!layout.done())
+		error("Unexpected end of file.\n");
+
+	// only used for the index converters
+	FpgaConfig fpga;
+	fpga.device = layout.device;
+	if (!device_bank_sizes(fpga.device, fpga.cram_width, fpga.cram_height, fpga.bram_width, fpga.bram_height))
+		error("Failed to detect chip type.\n");
+
+	// xor of the old and new value of each changed byte
+	std::map<int, uint8_t> changes;
+
+	// converters for the last tile, edits usually come tile by tile
+	std::unique_ptr<CramIndexConverter> cic;
+	std::unique_ptr<BramIndexConverter> bic;
+
+	for (auto &edit : edits)
+	{
+		bool bram = edit.kind == BitEdit::RAM_DATA_BIT || edit.kind == BitEdit::BRAM_BIT;
+		int bank = edit.bank, x = edit.bit_x, y = edit.bit_y;
+
+		if (edit.kind == BitEdit::TILE_BIT || edit.kind == BitEdit::RAM_DATA_BIT)
+		{
+			if (edit.tile_x < 0 || edit.tile_x > fpga.chip_width()+1 || edit.tile_y < 0 || edit.tile_y > fpga.chip_height()+1)
+				error("Tile %d %d is outside of the chip.\n", edit.tile_x, edit.tile_y);
+
+			if (bram) {
+				if (bic == nullptr || bic->tile_x != edit.tile_x || bic->tile_y != edit.tile_y) {
+					if (fpga.geometry().tile_type(edit.tile_x, edit.tile_y) != TILE_RAMB)
+						error("Tile %d %d is not a ramb tile.\n", edit.tile_x, edit.tile_y);
+					bic.reset(new BramIndexConverter(&fpga, edit.tile_x, edit.tile_y));
+				}
+				if (edit.bit_x < 0 || edit.bit_x >= 256 || edit.bit_y < 0 || edit.bit_y >= 16)
+					error("Bit %d %d is outside of the ram data of tile %d %d.\n", edit.bit_x, edit.bit_y, edit.tile_x, edit.tile_y);
+				bic->get_bram_index(edit.bit_x, edit.bit_y, bank, x, y);
+			} else {
+				if (cic == nullptr || cic->tile_x != edit.tile_x || cic->tile_y != edit.tile_y)
+					cic.reset(new CramIndexConverter(&fpga, edit.tile_x, edit.tile_y));
+				if (edit.bit_x < 0 || edit.bit_x >= cic->tile_width || edit.bit_y < 0 || edit.bit_y >= 16)
+					error("Bit %d %d is outside of tile %d %d.\n", edit.bit_x, edit.bit_y, edit.tile_x, edit.tile_y);
+				cic->get_cram_index(edit.bit_x, edit.bit_y, bank, x, y);
+			}
+		}
+
+		// the last block that contains the bit wins, as when loading the bitstream
+		int bit_pos = -1;
+		for (auto &block : layout.blocks) {
+			int index = (y - block.offset) * block.width + x;
+			if (block.bram == bram && block.bank == bank && block.offset <= y && x >= 0 && y < block.offset + block.height &&
+					x < block.width && index < block.width * block.height / 8 * 8)
+				bit_pos = 8 * block.file_offset + index;
+		}
+
+		if (bit_pos < 0)
+			error("%s bit %d %d %d is not in the bitstream.\n", bram ? "BRAM" : "CRAM", bank, x, y);
+
+		uint8_t &byte = data[bit_pos >> 3];
+		uint8_t old_byte = byte;
+
+		if (edit.value)
+			byte |= 0x80 >> (bit_pos & 7);
+		else
+			byte &= ~(0x80 >> (bit_pos & 7));
+
+		if (byte != old_byte)
+			changes[bit_pos >> 3] ^= byte ^ old_byte;
+	}
+
+	// A change of D in the byte at pos changes the CRC at the next check by
+	// crc16(0, D) shifted over the bytes in between, unless there is a CRC
+	// reset before that check. The check value is updated to match.
+	int num_changes = 0;
+
+	for (auto &it : changes)
+	{
+		int pos = it.first;
+		if (it.second == 0)
+			continue;
+		num_changes++;
+
+		auto check = std::upper_bound(layout.checks.begin(), layout.checks.end(), pos);
+		if (check == layout.checks.end())
+			continue;
+
+		int crc_pos = *check - 2;
+
+		auto reset = std::upper_bound(layout.resets.begin(), layout.resets.end(), pos);
+		if (reset != layout.resets.end() && *reset < crc_pos)
+			continue;
+
+		uint16_t delta = crc16_shift(crc16(0, &it.second, 1), crc_pos - pos - 1);
+		data[crc_pos] ^= delta >> 8;
+		data[crc_pos+1] ^= delta;
+	}
+
+	info("Changed %d bytes.\n", num_changes);
+}
+
+// a whitespace separated token in an in-memory .asc file
+struct AsciiToken
+{
+	const char *ptr;
+	int len;
+
+	bool operator==(const char *str) const { return int(strlen(str)) == len && memcmp(ptr, str, len) == 0; }
+	bool operator!=(const char *str) const { return !(*this == str); }
+	bool empty() const { return len == 0; }
+	string str() const { return string(ptr, len); }
+};
+
+// a line in an in-memory .asc file (without the '\n'), tokenized on demand
+struct AsciiLine
+{
+	const char *ptr = nullptr;
+	int len = 0, pos = 0;
+
+	bool starts_with_dot() const { return len > 0 && ptr[0] == '.'; }
+
+	AsciiToken next_token()
+	{
+		while (pos < len && isspace((unsigned char)ptr[pos]))
+			pos++;
+		AsciiToken token = { ptr + pos, 0 };
+		while (pos < len && !isspace((unsigned char)ptr[pos]))
+			pos++, token.len++;
+		return token;
+	}
+
+	int next_int()
+	{
+		AsciiToken token = next_token();
+		int value = 0, i = (token.len > 1 && token.ptr[0] == '-') ? 1 : 0;
+		if (i == token.len)
+			error("Expected integer argument in line '%.*s'.\n", len, ptr);
+		for (; i < token.len; i++) {
+			if (token.ptr[i] < '0' || '9' < token.ptr[i])
+				error("Expected integer argument in line '%.*s'.\n", len, ptr);
+			int digit = token.ptr[i] - '0';
+			if (value > (INT_MAX - digit) / 10)
+				error("Integer argument out of range in line '%.*s'.\n", len, ptr);
+			value = 10*value + digit;
+		}
+		return token.ptr[0] == '-' ? -value : value;
+	}
+};
+
+// split the next line off [p, end). returns false at the end of the input.
+static bool read_line(const char *&p, const char *end, AsciiLine &line)
+{
+	if (p == end)
+		return false;
+
+	const char *nl = (const char*)memchr(p, '\n', end - p);
+	line.ptr = p;
+	line.len = (nl ? nl : end) - p;
+	line.pos = 0;
+	p = nl ? nl + 1 : end;
+	return true;
+}
+
+// bit i of the result is set if line[i] == '1' (for i < len <= 64)
+static uint64_t scan_ones(const char *line, int len)
+{
+	uint64_t mask = 0;
+	int i = 0;
+#ifdef __SSE2__
+	const __m128i ones = _mm_set1_epi8('1');
+	for (; i + 16 <= len; i += 16) {
+		__m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(line + i));
+		mask |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, ones)))) << i;
+	}
+#endif
+	for (; i < len; i++)
+		if (line[i] == '1')
+			mask |= uint64_t(1) << i;
+	return mask;
+}
+
+static int count_trailing_zeros(uint64_t value)
+{
+#ifdef __GNUC__
+	return __builtin_ctzll(value);
+#else
+	int n = 0;
+	while ((value & 1) == 0)
+		value >>= 1, n++;
+	return n;
+#endif
+}
+
+static inline uint64_t load_be64(const uint8_t *p)
+{
+	uint64_t value = 0;
+	for (int i = 0; i < 8; i++)
+		value = (value << 8) | p[i];
+	return value;
+}
+
+static void read_stream(std::istream &ifs, vector<char> &data)
+{
+	char buffer[64*1024];
+	while (ifs.read(buffer, sizeof(buffer)), ifs.gcount() > 0)
+		data.insert(data.end(), buffer, buffer + ifs.gcount());
+}
+
+void FpgaConfig::read_ascii(std::istream &ifs)
+{
+	vector<char> text;
+	read_stream(ifs, text);
+	read_ascii(text.data(), text.size());
+}
+
+void FpgaConfig::read_ascii(const char *text, size_t text_len)
+{
+	debug("## %s\n", __PRETTY_FUNCTION__);
+	info("Parsing ascii file..\n");
+	ScopedTimer timer(TIMER_READ_ASCII);
+	stat_add(COUNTER_BYTES_PARSED, text_len);
+
+	bool got_device = false;
+	this->cram.clear();
+	this->bram.clear();
+	this->freqrange = "low";
+	this->warmboot = "enabled";
+
+	const char *p = text, *end = text + text_len;
+	bool reuse_line = true;
+	AsciiLine line;
+
+	while (reuse_line || read_line(p, end, line))
+	{
+		reuse_line = false;
+
+		line.pos = 0;
+		AsciiToken command = line.next_token();
+
+		if (command.empty())
+			continue;
+
+		debug("Next command: %.*s\n", line.len, line.ptr);
+
+		if (command == ".comment")
+		{
+			this->initblop.clear();
+			this->initblop.push_back(0xff);
+			this->initblop.push_back(0x00);
+
+			while (read_line(p, end, line))
+			{
+				if (line.starts_with_dot()) {
+					reuse_line = true;
+					break;
+				}
+
+				this->initblop.insert(this->initblop.end(), line.ptr, line.ptr + line.len);
+				this->initblop.push_back(0);
+			}
+
+			this->initblop.push_back(0x00);
+			this->initblop.push_back(0xff);
+			continue;
+		}
+
+		if (command == ".device")
+		{
+			if (got_device)
+				error("More than one .device statement.\n");
+
+			this->device = line.next_token().str();
+
+			if (!device_bank_sizes(this->device, this->cram_width, this->cram_height, this->bram_width, this->bram_height))
+				error("Unsupported chip type '%s'.\n", this->device.c_str());
+
+			this->cram.resize(4);
+			for (int i = 0; i < 4; i++)
+				this->cram[i].resize(this->cram_width, this->cram_height);
+
+			this->bram.resize(4);
+			for (int i = 0; i < 4; i++)
+				this->bram[i].resize(this->bram_width, this->bram_height);
+
+			got_device = true;
+			continue;
+		}
+
+		if (command == ".io_tile" || command == ".logic_tile" || command == ".ramb_tile" || command == ".ramt_tile")
+		{
+			if (!got_device)
+				error("Missing .device statement before %s.\n", command.str().c_str());
+
+			int tile_x = line.next_int();
+			int tile_y = line.next_int();
+
+			CramIndexConverter cic(this, tile_x, tile_y);
+
+			// command is ".<type>_tile"
+			int name_len = strlen(cic.tile_name);
+			if (command.len != name_len + 6 || memcmp(command.ptr + 1, cic.tile_name, name_len) != 0)
+				error("Got %s statement for %s tile %d %d.\n",
+						command.str().c_str(), cic.tile_name, tile_x, tile_y);
+
+			for (int bit_y = 0; bit_y < 16 && read_line(p, end, line); bit_y++)
+			{
+				if (line.starts_with_dot()) {
+					reuse_line = true;
+					break;
+				}
+
+				for (uint64_t ones = scan_ones(line.ptr, std::min(line.len, cic.tile_width)); ones; ones &= ones - 1) {
+					int cram_bank, cram_x, cram_y;
+					cic.get_cram_index(count_trailing_zeros(ones), bit_y, cram_bank, cram_x, cram_y);
+					this->cram[cram_bank].set(cram_x, cram_y);
+				}
+			}
+
+			continue;
+		}
+
+		if (command == ".ram_data")
+		{
+			if (!got_device)
+				error("Missing .device statement before %s.\n", command.str().c_str());
+
+			int tile_x = line.next_int();
+			int tile_y = line.next_int();
+
+			BramIndexConverter bic(this, tile_x, tile_y);
+
+			for (int bit_y = 0; bit_y < 16 && read_line(p, end, line); bit_y++)
+			{
+				if (line.starts_with_dot()) {
+					reuse_line = true;
+					break;
+				}
+
+				for (int bit_x = 256-4, ch_idx = 0; ch_idx < line.len && bit_x >= 0; bit_x -= 4, ch_idx++)
+				{
+					char ch = line.ptr[ch_idx];
+					int value = -1;
+					if ('0' <= ch && ch <= '9')
+						value = ch - '0';
+					if ('a' <= ch && ch <= 'f')
+						value = ch - 'a' + 10;
+					if ('A' <= ch && ch <= 'F')
+						value = ch - 'A' + 10;
+					if (value < 0)
+						error("Not a hex character: '%c' (in line '%.*s')\n", ch, line.len, line.ptr);
+
+					for (int i = 0; i < 4; i++)
+						if ((value & (1 << i)) != 0) {
+							int bram_bank, bram_x, bram_y;
+							bic.get_bram_index(bit_x+i, bit_y, bram_bank, bram_x, bram_y);
+							this->bram[bram_bank].set(bram_x, bram_y);
+						}
+				}
+			}
+
+			continue;
+		}
+
+		if (command == ".extra_bit")
+		{
+			if (!got_device)
+				error("Missing .device statement before %s.\n", command.str().c_str());
+
+			int cram_bank = line.next_int();
+			int cram_x = line.next_int();
+			int cram_y = line.next_int();
+
+			if (cram_bank < 0 || cram_bank > 3 || cram_x < 0 || cram_x >= this->cram_width || cram_y < 0 || cram_y >= this->cram_height)
+				error("Extra bit %d %d %d is outside of the CRAM banks.\n", cram_bank, cram_x, cram_y);
+
+			this->cram[cram_bank].set(cram_x, cram_y);
+
+			continue;
+		}
+
+		if (command == ".sym")
+		  continue;
+
+		if (command.ptr[0] == '.')
+			error("Unknown statement: %s\n", command.str().c_str());
+		error("Unexpected data line: %.*s\n", line.len, line.ptr);
+	}
+
+	// the banks are only set up by .device
+	if (!got_device)
+		error("Missing .device statement.\n");
+}
+
+// the 64 bits of a bit plane starting at bit i, MSB first
+static inline uint64_t load_bits64(const BitPlane &plane, int i)
+{
+	int k = (i >> 6) * 8, shift = i & 63;
+	uint64_t word = load_be64(&plane.data[k]) << shift;
+	if (shift && k + 8 < int(plane.data.size()))
+		word |= load_be64(&plane.data[k + 8]) >> (64 - shift);
+	return word;
+}
+
+// TILE_WIDTH = 0: tile width from cic at runtime, one bank lookup per bit.
+// otherwise tiles whose rows are runs of bits in a bank row are rendered
+// from one 64 bit word per row.
+template<int TILE_WIDTH>
+static void render_tile_bits_impl(const FpgaConfig *fpga, const CramIndexConverter &cic, char *out)
+{
+	const int tile_width = TILE_WIDTH ? TILE_WIDTH : cic.tile_width;
+	const BankIndex *idx = cic.index;
+
+	if (TILE_WIDTH && cic.row_dir != 0) {
+		// '0'/'1' characters for each byte value, and bit reversed bytes
+		static const struct ExpandTables {
+			char chars[256][8];
+			uint8_t reverse[256];
+			ExpandTables() {
+				for (int i = 0; i < 256; i++) {
+					reverse[i] = 0;
+					for (int k = 0; k < 8; k++) {
+						chars[i][k] = ((i << k) & 0x80) ? '1' : '0';
+						if ((i >> k) & 1)
+							reverse[i] |= 0x80 >> k;
+					}
+				}
+			}
+		} tables;
+
+		char row[64];
+		for (int bit_y = 0; bit_y < 16; bit_y++, idx += TILE_WIDTH) {
+			const BitPlane &plane = fpga->cram[idx->bank];
+			int x0 = cic.row_dir > 0 ? idx->x : idx->x - (TILE_WIDTH-1);
+			uint64_t word = load_bits64(plane, idx->y * plane.width + x0);
+			if (cic.row_dir < 0) {
+				uint64_t reversed = 0;
+				for (int k = 0; k < 8; k++, word >>= 8)
+					reversed = (reversed << 8) | tables.reverse[word & 0xff];
+				word = reversed << (64 - TILE_WIDTH);
+			}
+			for (int k = 0; k < TILE_WIDTH; k += 8)
+				memcpy(row + k, tables.chars[(word >> (56 - k)) & 0xff], 8);
+			row[TILE_WIDTH] = '\n';
+			memcpy(out, row, TILE_WIDTH + 1);
+			out += TILE_WIDTH + 1;
+		}
+		return;
+	}
+
+	const uint8_t *bank_data[4];
+	int bank_width[4];
+	for (int i = 0; i < 4; i++) {
+		bank_data[i] = fpga->cram[i].data.data();
+		bank_width[i] = fpga->cram[i].width;
+	}
+
+	for (int bit_y = 0; bit_y < 16; bit_y++) {
+		for (int bit_x = 0; bit_x < tile_width; bit_x++, idx++) {
+			int i = idx->y * bank_width[idx->bank] + idx->x;
+			*out++ = '0' + ((bank_data[idx->bank][i >> 3] >> (7 - (i & 7))) & 1);
+		}
+		*out++ = '\n';
+	}
+}
+
+void render_tile_bits_generic(const FpgaConfig *fpga, const CramIndexConverter &cic, char *out)
+{
+	render_tile_bits_impl<0>(fpga, cic, out);
+}
+
+void render_tile_bits(const FpgaConfig *fpga, const CramIndexConverter &cic, char *out)
+{
+	switch (cic.tile_width) {
+		case 18: render_tile_bits_impl<18>(fpga, cic, out); break;
+		case 42: render_tile_bits_impl<42>(fpga, cic, out); break;
+		case 54: render_tile_bits_impl<54>(fpga, cic, out); break;
+		default: render_tile_bits_impl<0>(fpga, cic, out); break;
+	}
+}
+
+// append the .*_tile block (and .ram_data block for ramb tiles) of a tile
+static void write_ascii_tile(const FpgaConfig *fpga, string &buf, int x, int y)
+{
+	CramIndexConverter cic(fpga, x, y);
+
+	if (cic.tile_type == TILE_CORNER)
+		return;
+
+	buf += stringf(".%s_tile %d %d\n", cic.tile_name, x, y);
+	stat_add(COUNTER_TILES_EMITTED, 1);
+
+	size_t pos = buf.size();
+	buf.resize(pos + 16 * (cic.tile_width + 1));
+	render_tile_bits(fpga, cic, &buf[pos]);
+
+	if (cic.tile_type == TILE_RAMB)
+	{
+		BramIndexConverter bic(fpga, x, y);
+		buf += stringf(".ram_data %d %d\n", x, y);
+
+		for (int bit_y = 0; bit_y < 16; bit_y++) {
+			for (int bit_x = 256-4; bit_x >= 0; bit_x -= 4) {
+				int value = 0;
+				for (int i = 0; i < 4; i++) {
+					int bram_bank, bram_x, bram_y;
+					bic.get_bram_index(bit_x+i, bit_y, bram_bank, bram_x, bram_y);
+					if (fpga->bram[bram_bank].get(bram_x, bram_y))
+						value += 1 << i;
+				}
+				buf += "0123456789abcdef"[value];
+			}
+			buf += '\n';
+		}
+	}
+}
+
+void FpgaConfig::write_ascii(std::ostream &ofs, int num_threads) const
+{
+	debug("## %s\n", __PRETTY_FUNCTION__);
+	info("Writing ascii file..\n");
+	ScopedTimer timer(TIMER_WRITE_ASCII);
+
+	string header = ".comment";
+	bool insert_newline = true;
+	for (auto ch : this->initblop) {
+		if (ch == 0) {
+			insert_newline = true;
+		} else if (ch == 0xff) {
+			insert_newline = false;
+		} else {
+			if (insert_newline)
+				header += '\n';
+			header += ch;
+			insert_newline = false;
+		}
+	}
+
+	header += stringf("\n.device %s\n", this->device.c_str());
+
+	// render each row of tiles into its own buffer (in parallel if requested)
+	// and write them out in order afterwards
+	vector<string> tile_rows(this->chip_height()+2);
+	string trailer;
+
+	{
+		ScopedTimer format_timer(TIMER_FORMAT_ASCII);
+
+		parallel_for(tile_rows.size(), num_threads, [&](int y) {
+			for (int x = 0; x <= this->chip_width()+1; x++)
+				write_ascii_tile(this, tile_rows[y], x, y);
+		});
+
+		vector<BankIndex> extra_bits;
+		this->get_extra_bits(extra_bits);
+
+		for (auto &it : extra_bits)
+			trailer += stringf(".extra_bit %d %d %d\n", it.bank, it.x, it.y);
+	}
+
+	ScopedTimer output_timer(TIMER_WRITE_OUTPUT);
+
+	ofs.write(header.data(), header.size());
+	stat_add(COUNTER_BYTES_WRITTEN, header.size());
+
+	for (auto &buf : tile_rows) {
+		ofs.write(buf.data(), buf.size());
+		stat_add(COUNTER_BYTES_WRITTEN, buf.size());
+	}
+
+	ofs.write(trailer.data(), trailer.size());
+	stat_add(COUNTER_BYTES_WRITTEN, trailer.size());
+
+#if 0
+	for (int i = 0; i < 4; i++) {
+		ofs << stringf(".bram_bank %d\n", i);
+		for (int x = 0; x < this->bram_width; x++) {
+			for (int y = 0; y < this->bram_height; y += 4)
+				ofs << "0123456789abcdef"[(this->bram[i].get(x, y) ? 1 : 0) + (this->bram[i].get(x, y+1) ? 2 : 0) +
+						(this->bram[i].get(x, y+2) ? 4 : 0) + (this->bram[i].get(x, y+3) ? 8 : 0)];
+			ofs << '\n';
+		}
+	}
+#endif
+}
+
+// Compact binary format: a fixed header followed by the initblop and the
+// raw bank planes, so that a file can be mapped and used without parsing.
+// All integers are little endian and all sections start at a multiple of
+// 8 bytes. Each bank is stored exactly as BitPlane::data, i.e. the packed
+// rows zero-padded to a multiple of 8 bytes, and the 4 banks of a kind are
+// stored back to back.
+//
+//   0  char[8]   magic "\x89ICECFG\n"
+//   8  uint32    format version (1)
+//  12  uint32    header size (readers must skip unknown header fields)
+//  16  char[16]  device, NUL terminated
+//  32  char[16]  freqrange, NUL terminated
+//  48  char[16]  warmboot, NUL terminated
+//  64  uint32    cram width, cram height
+//  72  uint32    bram width, bram height (the device size, or 0 if the
+//                file has no bram data)
+//  80  uint32    initblop offset, initblop size
+//  88  uint32    cram offset, bram offset
+
+static const char binary_magic[8] = { '\x89', 'I', 'C', 'E', 'C', 'F', 'G', '\n' };
+static const int binary_version = 1;
+static const int binary_header_size = 96;
+
+static inline uint32_t load_le32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24);
+}
+
+static inline void store_le32(uint8_t *p, uint32_t value)
+{
+	p[0] = value, p[1] = value >> 8, p[2] = value >> 16, p[3] = value >> 24;
+}
+
+static inline size_t plane_bytes(int width, int height)
+{
+	return size_t(width * height + 63) / 64 * 8;
+}
+
+bool FpgaConfig::is_binary(const void *data, size_t len)
+{
+	return len >= sizeof(binary_magic) && memcmp(data, binary_magic, sizeof(binary_magic)) == 0;
+}
+
+// only looks at the first byte, which is never used by bitstreams or .asc files
+bool FpgaConfig::is_binary(std::istream &ifs)
+{
+	return ifs.peek() == (unsigned char)binary_magic[0];
+}
+
+void FpgaConfig::read_binary(std::istream &ifs)
+{
+	vector<char> data;
+	read_stream(ifs, data);
+	read_binary(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+}
+
+void FpgaConfig::read_binary(const uint8_t *data, size_t len)
+{
+	debug("## %s\n", __PRETTY_FUNCTION__);
+	info("Reading binary config file..\n");
+	stat_add(COUNTER_BYTES_PARSED, len);
+
+	if (!is_binary(data, len) || len < binary_header_size)
+		error("Input is not a binary config file.\n");
+
+	uint32_t version = load_le32(data + 8);
+	uint32_t header_size = load_le32(data + 12);
+
+	if (version != binary_version)
+		error("Unsupported binary config file version %u.\n", version);
+	if (header_size < binary_header_size || header_size > len)
+		error("Invalid binary config header size %u.\n", header_size);
+
+	auto header_string = [&](int offset) {
+		const char *p = reinterpret_cast<const char*>(data + offset);
+		return string(p, strnlen(p, 15));
+	};
+
+	this->device = header_string(16);
+	this->freqrange = header_string(32);
+	this->warmboot = header_string(48);
+
+	int cram_width, cram_height, bram_width, bram_height;
+	if (!device_bank_sizes(this->device, cram_width, cram_height, bram_width, bram_height))
+		error("Unsupported chip type '%s'.\n", this->device.c_str());
+
+	this->cram_width = load_le32(data + 64);
+	this->cram_height = load_le32(data + 68);
+	this->bram_width = load_le32(data + 72);
+	this->bram_height = load_le32(data + 76);
+
+	if (this->cram_width != cram_width || this->cram_height != cram_height)
+		error("Invalid cram size %dx%d for chip type '%s'.\n", this->cram_width, this->cram_height, this->device.c_str());
+	if ((this->bram_width != 0 || this->bram_height != 0) && (this->bram_width != bram_width || this->bram_height != bram_height))
+		error("Invalid bram size %dx%d for chip type '%s'.\n", this->bram_width, this->bram_height, this->device.c_str());
+
+	// check that [offset, offset+size) lies within the file
+	auto check_section = [&](const char *name, uint32_t offset, size_t size) {
+		if (offset < header_size || offset > len || size > len - offset)
+			error("Binary config file is truncated (%s section).\n", name);
+	};
+
+	uint32_t initblop_offset = load_le32(data + 80);
+	uint32_t initblop_size = load_le32(data + 84);
+	check_section("initblop", initblop_offset, initblop_size);
+	this->initblop.assign(data + initblop_offset, data + initblop_offset + initblop_size);
+
+	// copy the bits, but not the padding: BitPlane expects it to be zero
+	auto read_planes = [&](vector<BitPlane> &planes, const char *name, uint32_t offset, int width, int height) {
+		size_t stride = plane_bytes(width, height);
+		check_section(name, offset, 4 * stride);
+		planes.resize(4);
+		for (int i = 0; i < 4; i++) {
+			planes[i].resize(width, height);
+			planes[i].clear();
+			planes[i].load_rows(0, height, data + offset + i * stride);
+		}
+	};
+
+	read_planes(this->cram, "cram", load_le32(data + 88), this->cram_width, this->cram_height);
+
+	// a file without bram data on a device with bram gives zero banks
+	this->bram.clear();
+	if (this->bram_width && this->bram_height) {
+		read_planes(this->bram, "bram", load_le32(data + 92), this->bram_width, this->bram_height);
+	} else if (bram_width && bram_height) {
+		this->bram_width = bram_width;
+		this->bram_height = bram_height;
+		this->bram.resize(4);
+		for (auto &plane : this->bram)
+			plane.resize(bram_width, bram_height);
+	}
+}
+
+void FpgaConfig::write_binary(std::ostream &ofs) const
+{
+	vector<uint8_t> data;
+	write_binary(data);
+
+	ScopedTimer timer(TIMER_WRITE_OUTPUT);
+	ofs.write(reinterpret_cast<const char*>(data.data()), data.size());
+	stat_add(COUNTER_BYTES_WRITTEN, data.size());
+}
+
+void FpgaConfig::write_binary(vector<uint8_t> &data) const
+{
+	debug("## %s\n", __PRETTY_FUNCTION__);
+	info("Writing binary config file..\n");
+
+	bool have_bram = this->bram_width && this->bram_height && !this->bram.empty();
+	size_t cram_stride = plane_bytes(this->cram_width, this->cram_height);
+	size_t bram_stride = have_bram ? plane_bytes(this->bram_width, this->bram_height) : 0;
+
+	uint32_t initblop_offset = binary_header_size;
+	uint32_t cram_offset = (initblop_offset + this->initblop.size() + 7) & ~7;
+	uint32_t bram_offset = have_bram ? cram_offset + 4 * cram_stride : 0;
+
+	data.assign(cram_offset + 4 * cram_stride + 4 * bram_stride, 0);
+
+	memcpy(&data[0], binary_magic, sizeof(binary_magic));
+	store_le32(&data[8], binary_version);
+	store_le32(&data[12], binary_header_size);
+
+	auto header_string = [&](int offset, const string &value) {
+		if (value.size() > 15)
+			error("Header field '%s' is too long for a binary config file.\n", value.c_str());
+		memcpy(&data[offset], value.data(), value.size());
+	};
+
+	header_string(16, this->device);
+	header_string(32, this->freqrange);
+	header_string(48, this->warmboot);
+
+	store_le32(&data[64], this->cram_width);
+	store_le32(&data[68], this->cram_height);
+	store_le32(&data[72], have_bram ? this->bram_width : 0);
+	store_le32(&data[76], have_bram ? this->bram_height : 0);
+	store_le32(&data[80], initblop_offset);
+	store_le32(&data[84], this->initblop.size());
+	store_le32(&data[88], cram_offset);
+	store_le32(&data[92], bram_offset);
+
+	std::copy(this->initblop.begin(), this->initblop.end(), data.begin() + initblop_offset);
+
+	for (int i = 0; i < 4; i++)
+		this->cram[i].store_rows(0, this->cram_height, &data[cram_offset + i * cram_stride]);
+
+	if (have_bram)
+		for (int i = 0; i < 4; i++)
+			this->bram[i].store_rows(0, this->bram_height, &data[bram_offset + i * bram_stride]);
+}
+
+void FpgaConfig::get_extra_bits(vector<BankIndex> &extra_bits) const
+{
+	const DeviceTables &tables = DeviceTables::get(this);
+
+	extra_bits.clear();
+
+	for (int i = 0; i < 4; i++)
+	{
+		const BitPlane &bits = this->cram[i];
+		const BitPlane &covered = tables.cram_covered[i];
+		size_t first = extra_bits.size();
+
+		for (int k = 0; k < int(bits.data.size()); k += 8)
+			for (uint64_t word = load_be64(&bits.data[k]) & ~load_be64(&covered.data[k]); word; word &= word - 1) {
+				int index = 8*k + 63 - count_trailing_zeros(word);
+				BankIndex idx = { uint8_t(i), uint16_t(index % bits.width), uint16_t(index / bits.width) };
+				extra_bits.push_back(idx);
+			}
+
+		// the scan finds them in (y, x) order
+		std::sort(extra_bits.begin() + first, extra_bits.end(), [](const BankIndex &a, const BankIndex &b) {
+			return a.x != b.x ? a.x < b.x : a.y < b.y;
+		});
+	}
+}
+
+// differing bit in the tile view: tile (x, y), section (0 = tile bits,
+// 1 = ram data), bit (x, y), and the value in the first config
+struct DiffBit
+{
+	int tile_x, tile_y, section, bit_x, bit_y;
+	bool value;
+
+	bool operator<(const DiffBit &other) const {
+		if (tile_y != other.tile_y) return tile_y < other.tile_y;
+		if (tile_x != other.tile_x) return tile_x < other.tile_x;
+		if (section != other.section) return section < other.section;
+		if (bit_y != other.bit_y) return bit_y < other.bit_y;
+		return bit_x < other.bit_x;
+	}
+};
+
+// reverse of the index converters: (tile_idx * 16 + bit_y) * 256 + bit_x
+// for every bank bit that belongs to a tile, or -1
+static void build_reverse_index(const FpgaConfig *fpga, bool bram, vector<vector<int>> &reverse)
+{
+	int tiles_x = fpga->chip_width() + 2;
+	int tiles_y = fpga->chip_height() + 2;
+
+	const vector<BitPlane> &planes = bram ? fpga->bram : fpga->cram;
+
+	reverse.resize(4);
+	for (int i = 0; i < 4; i++)
+		reverse[i].assign(planes[i].num_bits(), -1);
+
+	for (int tile_y = 0; tile_y < tiles_y; tile_y++)
+	for (int tile_x = 0; tile_x < tiles_x; tile_x++)
+	{
+		int tile_code = (tile_y * tiles_x + tile_x) * 16;
+
+		if (!bram) {
+			CramIndexConverter cic(fpga, tile_x, tile_y);
+			for (int bit_y = 0; bit_y < 16; bit_y++)
+			for (int bit_x = 0; bit_x < cic.tile_width; bit_x++) {
+				int bank, x, y;
+				cic.get_cram_index(bit_x, bit_y, bank, x, y);
+				reverse[bank][y * planes[bank].width + x] = (tile_code + bit_y) * 256 + bit_x;
+			}
+		} else if (fpga->geometry().tile_type(tile_x, tile_y) == TILE_RAMB) {
+			BramIndexConverter bic(fpga, tile_x, tile_y);
+			for (int bit_y = 0; bit_y < 16; bit_y++)
+			for (int bit_x = 0; bit_x < 256; bit_x++) {
+				int bank, x, y;
+				bic.get_bram_index(bit_x, bit_y, bank, x, y);
+				if (x < planes[bank].width && y < planes[bank].height)
+					reverse[bank][y * planes[bank].width + x] = (tile_code + bit_y) * 256 + bit_x;
+			}
+		}
+	}
+}
+
+int FpgaConfig::write_diff(std::ostream &ofs, const FpgaConfig &other) const
+{
+	debug("## %s\n", __PRETTY_FUNCTION__);
+	info("Comparing configs..\n");
+
+	if (this->device != other.device)
+		error("Cannot compare configs for different chip types ('%s' and '%s').\n",
+				this->device.c_str(), other.device.c_str());
+
+	int num_diffs = 0;
+
+	if (this->freqrange != other.freqrange) {
+		ofs << stringf(".freqrange %s %s\n", this->freqrange.c_str(), other.freqrange.c_str());
+		num_diffs++;
+	}
+
+	if (this->warmboot != other.warmboot) {
+		ofs << stringf(".warmboot %s %s\n", this->warmboot.c_str(), other.warmboot.c_str());
+		num_diffs++;
+	}
+
+	vector<DiffBit> diff_bits;
+	vector<BankIndex> extra_bits[2];
+
+	for (int section = 0; section < 2; section++)
+	{
+		bool bram = section == 1;
+		const vector<BitPlane> &planes = bram ? this->bram : this->cram;
+		const vector<BitPlane> &other_planes = bram ? other.bram : other.cram;
+
+		if (planes.size() != other_planes.size() || (planes.size() == 4 && (planes[0].width != other_planes[0].width ||
+				planes[0].height != other_planes[0].height))) {
+			ofs << stringf(".%s_size %dx%d %dx%d\n", bram ? "bram" : "cram", bram ? this->bram_width : this->cram_width,
+					bram ? this->bram_height : this->cram_height, bram ? other.bram_width : other.cram_width,
+					bram ? other.bram_height : other.cram_height);
+			num_diffs++;
+			continue;
+		}
+
+		vector<vector<int>> reverse;
+
+		for (int i = 0; i < int(planes.size()); i++)
+		{
+			const BitPlane &a = planes[i], &b = other_planes[i];
+
+			for (int k = 0; k < int(a.data.size()); k += 8)
+				for (uint64_t word = load_be64(&a.data[k]) ^ load_be64(&b.data[k]); word; word &= word - 1)
+				{
+					int index = 8*k + 63 - count_trailing_zeros(word);
+					int x = index % a.width, y = index / a.width;
+
+					if (reverse.empty())
+						build_reverse_index(this, bram, reverse);
+
+					int code = reverse[i][index];
+					if (code < 0) {
+						BankIndex idx = { uint8_t(i), uint16_t(x), uint16_t(y) };
+						extra_bits[section].push_back(idx);
+						continue;
+					}
+
+					int tile_idx = code / (16 * 256), tiles_x = this->chip_width() + 2;
+					DiffBit bit = { tile_idx % tiles_x, tile_idx / tiles_x, section, code % 256, code / 256 % 16, a.get(x, y) };
+					diff_bits.push_back(bit);
+				}
+		}
+	}
+
+	std::sort(diff_bits.begin(), diff_bits.end());
+
+	for (int i = 0; i < int(diff_bits.size()); i++)
+	{
+		const DiffBit &bit = diff_bits[i];
+
+		if (i == 0 || bit.tile_x != diff_bits[i-1].tile_x || bit.tile_y != diff_bits[i-1].tile_y || bit.section != diff_bits[i-1].section) {
+			if (bit.section == 0)
+				ofs << stringf(".%s_tile %d %d\n", DeviceGeometry::tile_type_name(this->geometry().tile_type(bit.tile_x, bit.tile_y)), bit.tile_x, bit.tile_y);
+			else
+				ofs << stringf(".ram_data %d %d\n", bit.tile_x, bit.tile_y);
+		}
+
+		ofs << stringf("B%d[%d] %d %d\n", bit.bit_y, bit.bit_x, bit.value, !bit.value);
+	}
+
+	// bits outside of all tiles, as .extra_bit (cram) or .extra_bram_bit
+	for (int section = 0; section < 2; section++)
+	{
+		bool bram = section == 1;
+		const vector<BitPlane> &planes = bram ? this->bram : this->cram;
+		const vector<BitPlane> &other_planes = bram ? other.bram : other.cram;
+
+		std::sort(extra_bits[section].begin(), extra_bits[section].end(), [](const BankIndex &a, const BankIndex &b) {
+			return a.bank != b.bank ? a.bank < b.bank : a.x != b.x ? a.x < b.x : a.y < b.y;
+		});
+
+		for (auto &it : extra_bits[section])
+			ofs << stringf(".extra_%sbit %d %d %d %d %d\n", bram ? "bram_" : "", it.bank, it.x, it.y,
+					planes[it.bank].get(it.x, it.y), other_planes[it.bank].get(it.x, it.y));
+
+		num_diffs += extra_bits[section].size();
+	}
+
+	num_diffs += diff_bits.size();
+	return num_diffs;
+}
+
+// Write the four banks as one bitmap, each mirrored so that bank 0 is in
+// the bottom left corner, bank 1 in the bottom right corner, bank 2 at the
+// top left and bank 3 at the top right. Rows are assembled in packed form
+// and then written as binary P4 or expanded to ASCII P1 bytewise.
+static void write_pbm(std::ostream &ofs, const vector<BitPlane> &planes, int width, int height, int bank_num, bool binary)
+{
+	static const struct PbmTables {
+		uint8_t reverse[256];
+		char ascii[256][16];
+		PbmTables() {
+			for (int i = 0; i < 256; i++) {
+				reverse[i] = 0;
+				for (int k = 0; k < 8; k++) {
+					if ((i >> k) & 1)
+						reverse[i] |= 0x80 >> k;
+					ascii[i][2*k] = ' ';
+					ascii[i][2*k+1] = ((i << k) & 0x80) ? '1' : '0';
+				}
+			}
+		}
+	} tables;
+
+	int row_bytes = (2*width + 7) / 8;
+	int bank_row_bytes = (width + 7) / 8;
+
+	vector<uint8_t> row(row_bytes + 1), bank_row(bank_row_bytes + 1), reversed_row(bank_row_bytes + 1);
+	string text;
+
+	ofs << (binary ? "P4\n" : "P1\n");
+	ofs << stringf("%d %d\n", 2*width, 2*height);
+
+	for (int y = 2*height-1; y >= 0; y--)
+	{
+		int bank_y = y < height ? y : 2*height - y - 1;
+		int left_bank = y < height ? 0 : 2, right_bank = left_bank | 1;
+
+		std::fill(row.begin(), row.end(), 0);
+
+		// left half: bank row as is
+		if (bank_num < 0 || bank_num == left_bank)
+			copy_bits(row.data(), 0, planes[left_bank].data.data(), bank_y * width, width);
+
+		// right half: bank row mirrored, by reversing the bytes and the bits in each
+		// byte. the padding of the last byte ends up at the beginning.
+		if (bank_num < 0 || bank_num == right_bank) {
+			copy_bits(bank_row.data(), 0, planes[right_bank].data.data(), bank_y * width, width);
+			for (int i = 0; i < bank_row_bytes; i++)
+				reversed_row[i] = tables.reverse[bank_row[bank_row_bytes-1-i]];
+			copy_bits(row.data(), width, reversed_row.data(), 8*bank_row_bytes - width, width);
+		}
+
+		if (binary) {
+			ofs.write(reinterpret_cast<const char*>(row.data()), row_bytes);
+			continue;
+		}
+
+		text.clear();
+		for (int i = 0; i < 2*width / 8; i++)
+			text.append(tables.ascii[row[i]], 16);
+		text.append(tables.ascii[row[2*width / 8]], 2 * (2*width % 8));
+		text += '\n';
+		ofs.write(text.data(), text.size());
+	}
+}
+
+void FpgaConfig::write_cram_pbm(std::ostream &ofs, int bank_num, bool binary) const
+{
+	debug("## %s\n", __PRETTY_FUNCTION__);
+	info("Writing cram pbm file..\n");
+
+	write_pbm(ofs, this->cram, this->cram_width, this->cram_height, bank_num, binary);
+}
+
+void FpgaConfig::write_bram_pbm(std::ostream &ofs, int bank_num, bool binary) const
+{
+	debug("## %s\n", __PRETTY_FUNCTION__);
+	info("Writing bram pbm file..\n");
+
+	write_pbm(ofs, this->bram, this->bram_width, this->bram_height, bank_num, binary);
+}
+
+const DeviceGeometry &FpgaConfig::geometry() const
+{
+	const DeviceGeometry *geom = DeviceGeometry::find(this->device);
+	if (geom == nullptr)
+		error("Unknown chip type '%s'.\n", this->device.c_str());
+	return *geom;
+}
+
+int FpgaConfig::chip_width() const
+{
+	return this->geometry().chip_width;
+}
+
+int FpgaConfig::chip_height() const
+{
+	return this->geometry().chip_height;
+}
+
+const vector<int> &FpgaConfig::chip_cols() const
+{
+	return this->geometry().cols;
+}
+
+string FpgaConfig::tile_type(int x, int y) const
+{
+	const DeviceGeometry &geom = this->geometry();
+	if (x < 0 || x > geom.chip_width+1 || y < 0 || y > geom.chip_height+1)
+		return "logic";
+	return DeviceGeometry::tile_type_name(geom.tile_type(x, y));
+}
+
+int FpgaConfig::tile_width(const string &type) const
+{
+	if (type == "corner") return 0;
+	if (type == "logic")  return 54;
+	if (type == "ramb")   return 42;
+	if (type == "ramt")   return 42;
+	if (type == "io")     return 18;
+	error("Unknown tile type '%s'.\n", type.c_str());
+}
+
+void FpgaConfig::cram_clear()
+{
+	for (int i = 0; i < 4; i++)
+		this->cram[i].clear();
+}
+
+void FpgaConfig::cram_fill_tiles()
+{
+	for (int y = 0; y <= this->chip_height()+1; y++)
+	for (int x = 0; x <= this->chip_width()+1; x++)
+	{
+		CramIndexConverter cic(this, x, y);
+
+		for (int bit_y = 0; bit_y < 16; bit_y++)
+		for (int bit_x = 0; bit_x < cic.tile_width; bit_x++) {
+			int cram_bank, cram_x, cram_y;
+			cic.get_cram_index(bit_x, bit_y, cram_bank, cram_x, cram_y);
+			this->cram[cram_bank].set(cram_x, cram_y);
+		}
+	}
+}
+
+void FpgaConfig::cram_checkerboard(int m)
+{
+	for (int y = 0; y <= this->chip_height()+1; y++)
+	for (int x = 0; x <= this->chip_width()+1; x++)
+	{
+		if ((x+y) % 2 == m)
+			continue;
+			
+		CramIndexConverter cic(this, x, y);
+
+		for (int bit_y = 0; bit_y < 16; bit_y++)
+		for (int bit_x = 0; bit_x < cic.tile_width; bit_x++) {
+			int cram_bank, cram_x, cram_y;
+			cic.get_cram_index(bit_x, bit_y, cram_bank, cram_x, cram_y);
+			this->cram[cram_bank].set(cram_x, cram_y);
+		}
+	}
+}
+
+const char *DeviceGeometry::tile_type_name(TileType type)
+{
+	switch (type) {
+		case TILE_CORNER: return "corner";
+		case TILE_IO:     return "io";
+		case TILE_LOGIC:  return "logic";
+		case TILE_RAMB:   return "ramb";
+		case TILE_RAMT:   return "ramt";
+	}
+	error("Unknown tile type %d.\n", int(type));
+}
+
+int DeviceGeometry::tile_width(TileType type)
+{
+	switch (type) {
+		case TILE_CORNER: return 0;
+		case TILE_IO:     return 18;
+		case TILE_LOGIC:  return 54;
+		case TILE_RAMB:   return 42;
+		case TILE_RAMT:   return 42;
+	}
+	error("Unknown tile type %d.\n", int(type));
+}
+
+DeviceTables::DeviceTables(const DeviceGeometry &geom)
+{
+	static const int io_top_bottom_permx[18] = {23, 25, 26, 27, 16, 17, 18, 19, 20, 14, 32, 33, 34, 35, 36, 37, 4, 5};
+	static const int io_top_bottom_permy[16] = {0, 1, 3, 2, 4, 5, 7, 6, 8, 9, 11, 10, 12, 13, 15, 14};
+
+	debug("Building index tables for chip type '%s'.\n", geom.name.c_str());
+
+	this->chip_width = geom.chip_width;
+	this->chip_height = geom.chip_height;
+
+	this->cram_covered.resize(4);
+	for (int i = 0; i < 4; i++)
+		this->cram_covered[i].resize(geom.cram_width, geom.cram_height);
+
+	for (int tile_y = 0; tile_y <= this->chip_height+1; tile_y++)
+	for (int tile_x = 0; tile_x <= this->chip_width+1; tile_x++)
+	{
+		TileType tile_type = geom.tile_type(tile_x, tile_y);
+		int tile_width = DeviceGeometry::tile_width(tile_type);
+
+		this->cram_offset.push_back(this->cram_index.size());
+
+		bool left_right_io = tile_x == 0 || tile_x == this->chip_width+1;
+		bool right_half = tile_x > this->chip_width / 2;
+		bool top_half = tile_y > this->chip_height / 2;
+
+		int bank_num = 0;
+		if (top_half) bank_num |= 1;
+		if (right_half) bank_num |= 2;
+
+		int bank_tx = right_half ? this->chip_width  + 1 - tile_x : tile_x;
+		int bank_ty = top_half   ? this->chip_height + 1 - tile_y : tile_y;
+
+		int bank_xoff = geom.col_offset.at(bank_tx);
+		int bank_yoff = 16 * bank_ty;
+		int column_width = geom.cols.at(bank_tx);
+
+		for (int bit_y = 0; bit_y < 16; bit_y++)
+		for (int bit_x = 0; bit_x < tile_width; bit_x++)
+		{
+			int cram_x, cram_y;
+
+			if (tile_type == TILE_IO)
+			{
+				if (left_right_io)
+				{
+					cram_x = bank_xoff + column_width - 1 - bit_x;
+
+					if (top_half)
+						cram_y = bank_yoff + 15 - bit_y;
+					else
+						cram_y = bank_yoff + bit_y;
+				}
+				else
+				{
+					cram_y = bank_yoff + 15 - io_top_bottom_permy[bit_y];
+
+					if (right_half)
+						cram_x = bank_xoff + column_width - 1 - io_top_bottom_permx[bit_x];
+					else
+						cram_x = bank_xoff + io_top_bottom_permx[bit_x];
+				}
+			}
+			else
+			{
+				if (right_half)
+					cram_x = bank_xoff + column_width - 1 - bit_x;
+				else
+					cram_x = bank_xoff + bit_x;
+
+				if (top_half)
+					cram_y = bank_yoff + (15 - bit_y);
+				else
+					cram_y = bank_yoff + bit_y;
+			}
+
+			BankIndex idx = { uint8_t(bank_num), uint16_t(cram_x), uint16_t(cram_y) };
+			this->cram_index.push_back(idx);
+			this->cram_covered[bank_num].set(cram_x, cram_y);
+		}
+
+		// check if every row of the tile is a run of bits in one bank row
+		const BankIndex *tile_index = this->cram_index.data() + this->cram_offset.back();
+		int row_dir = tile_width > 1 ? tile_index[1].x - tile_index[0].x : 0;
+		if (row_dir != 1 && row_dir != -1)
+			row_dir = 0;
+		for (int bit_y = 0; bit_y < 16 && row_dir; bit_y++)
+		for (int bit_x = 1; bit_x < tile_width && row_dir; bit_x++) {
+			const BankIndex &first = tile_index[bit_y*tile_width], &idx = tile_index[bit_y*tile_width + bit_x];
+			if (idx.bank != first.bank || idx.y != first.y || idx.x != first.x + row_dir * bit_x)
+				row_dir = 0;
+		}
+		this->cram_row_dir.push_back(row_dir);
+	}
+
+	for (int bit_y = 0; bit_y < 16; bit_y++)
+	for (int bit_x = 0; bit_x < 256; bit_x++)
+	{
+		int index = 256 * bit_y + (16*(bit_x/16) + 15 - bit_x%16);
+		BankIndex idx = { 0, uint16_t(index % 16), uint16_t(index / 16) };
+		this->bram_index.push_back(idx);
+	}
+}
+
+const DeviceTables &DeviceTables::get(const FpgaConfig *fpga)
+{
+	const vector<DeviceGeometry> &geometries = device_geometries();
+	static vector<std::once_flag> cache_flags(geometries.size());
+	static vector<std::unique_ptr<DeviceTables>> cache(geometries.size());
+
+	const DeviceGeometry &geom = fpga->geometry();
+	int geom_idx = &geom - geometries.data();
+
+	std::call_once(cache_flags[geom_idx], [&]() {
+		cache[geom_idx].reset(new DeviceTables(geom));
+	});
+
+	return *cache[geom_idx];
+}
+
+CramIndexConverter::CramIndexConverter(const FpgaConfig *fpga, int tile_x, int tile_y)
+{
+	this->fpga = fpga;
+	this->tile_x = tile_x;
+	this->tile_y = tile_y;
+
+	const DeviceTables &tables = DeviceTables::get(fpga);
+
+	if (this->tile_x < 0 || this->tile_x > tables.chip_width+1 || this->tile_y < 0 || this->tile_y > tables.chip_height+1)
+		error("Tile %d %d is outside of the chip.\n", this->tile_x, this->tile_y);
+
+	this->tile_type = fpga->geometry().tile_type(this->tile_x, this->tile_y);
+	this->tile_name = DeviceGeometry::tile_type_name(this->tile_type);
+	this->tile_width = DeviceGeometry::tile_width(this->tile_type);
+
+	int tile_idx = this->tile_y * (tables.chip_width + 2) + this->tile_x;
+	this->index = tables.cram_index.data() + tables.cram_offset[tile_idx];
+	this->row_dir = tables.cram_row_dir[tile_idx];
+}
+
+BramIndexConverter::BramIndexConverter(const FpgaConfig *fpga, int tile_x, int tile_y)
+{
+	this->fpga = fpga;
+	this->tile_x = tile_x;
+	this->tile_y = tile_y;
+
+	const DeviceGeometry &geom = fpga->geometry();
+	int chip_width = geom.chip_width;
+	int chip_height = geom.chip_height;
+
+	bool right_half = this->tile_x > chip_width / 2;
+	bool top_half = this->tile_y > chip_height / 2;
+
+	this->bank_num = 0;
+	if (top_half) this->bank_num |= 1;
+	if (right_half) this->bank_num |= 2;
+
+	if (this->tile_x < 0 || this->tile_x > chip_width+1 || this->tile_y < 0 || this->tile_y > chip_height+1)
+		error("Tile %d %d is outside of the chip.\n", this->tile_x, this->tile_y);
+
+	if (geom.tile_type(this->tile_x, this->tile_y) != TILE_RAMB || fpga->bram_width == 0 || fpga->bram_height == 0)
+		error("Tile %d %d is not a ramb tile.\n", this->tile_x, this->tile_y);
+
+	this->bank_off = 16 * ((top_half ? this->tile_y - chip_height / 2 : this->tile_y - 1) / 2);
+
+	this->index = DeviceTables::get(fpga).bram_index.data();
+}
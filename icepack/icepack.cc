@@ -16,1057 +16,430 @@
 //  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 //
 
-#if !defined(_WIN32) && !defined(_GNU_SOURCE)
-// for vasprintf()
-#define _GNU_SOURCE
-#endif
-
-#include <set>
-#include <tuple>
 #include <vector>
 #include <string>
 #include <fstream>
 #include <iostream>
-#include <algorithm>
 #include <sstream>
-#include <cstdint>
+#include <chrono>
+#include <iterator>
+#include <algorithm>
+#include <new>
 
 #include <stdio.h>
-#include <stdarg.h>
-
-#ifdef _WIN32
-#define __PRETTY_FUNCTION__ __FUNCTION__
-#endif
+#include <stdlib.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
 
+#include "icepack.h"
+#include "util.h"
 
 using std::vector;
 using std::string;
 
-int log_level = 0;
-#define log(...) fprintf(stderr, __VA_ARGS__);
-#define info(...) do { if (log_level > 0) fprintf(stderr, __VA_ARGS__); } while (0)
-#define debug(...) do { if (log_level > 1) fprintf(stderr, __VA_ARGS__); } while (0)
-#define error(...) do { fprintf(stderr, "Error: " __VA_ARGS__); exit(1); } while (0)
-#define panic(fmt, ...) do { fprintf(stderr, "Internal Error at %s:%d: " fmt, __FILE__, __LINE__, ##__VA_ARGS__); abort(); } while (0)
+// ==================================================================
+// Statistics
 
-string vstringf(const char *fmt, va_list ap)
+// count allocations for the -T/-J reports (all replaceable forms, so that
+// every new is paired with a matching delete)
+void *operator new(size_t size)
 {
-	string string;
-	char *str = NULL;
-
-#ifdef _WIN32
-	int sz = 64, rc;
-	while (1) {
-		va_list apc;
-		va_copy(apc, ap);
-		str = (char*)realloc(str, sz);
-		rc = vsnprintf(str, sz, fmt, apc);
-		va_end(apc);
-		if (rc >= 0 && rc < sz)
-			break;
-		sz *= 2;
-	}
-#else
-	if (vasprintf(&str, fmt, ap) < 0)
-		str = NULL;
-#endif
-
-	if (str != NULL) {
-		string = str;
-		free(str);
-	}
-
-	return string;
+	if (stats_enabled)
+		stat_add(COUNTER_ALLOCATIONS, 1);
+	void *ptr = malloc(size ? size : 1);
+	if (ptr == nullptr)
+		throw std::bad_alloc();
+	return ptr;
 }
 
-string stringf(const char *fmt, ...)
+void *operator new[](size_t size)
 {
-	string string;
-	va_list ap;
-
-	va_start(ap, fmt);
-	string = vstringf(fmt, ap);
-	va_end(ap);
-
-	return string;
+	return operator new(size);
 }
 
-// ==================================================================
-// FpgaConfig stuff
-
-struct FpgaConfig
+void operator delete(void *ptr) noexcept
 {
-	string device;
-	string freqrange;
-	string warmboot;
-
-	// cram[BANK][X][Y]
-	int cram_width, cram_height;
-	vector<vector<vector<bool>>> cram;
-
-	// bram[BANK][X][Y]
-	int bram_width, bram_height;
-	vector<vector<vector<bool>>> bram;
-
-	// data before preamble
-	vector<uint8_t> initblop;
-
-	// bitstream i/o
-	void read_bits(std::istream &ifs);
-	void write_bits(std::ostream &ofs) const;
-
-	// icebox i/o
-	void read_ascii(std::istream &ifs);
-	void write_ascii(std::ostream &ofs) const;
-
-	// netpbm i/o
-	void write_cram_pbm(std::ostream &ofs, int bank_num = -1) const;
-	void write_bram_pbm(std::ostream &ofs, int bank_num = -1) const;
-
-	// query chip type metadata
-	int chip_width() const;
-	int chip_height() const;
-	vector<int> chip_cols() const;
-
-	// query tile metadata
-	string tile_type(int x, int y) const;
-	int tile_width(const string &type) const;
-
-	// cram bit manipulation
-	void cram_clear();
-	void cram_fill_tiles();
-	void cram_checkerboard(int m = 0);
-};
-
-struct CramIndexConverter
-{
-	const FpgaConfig *fpga;
-	int tile_x, tile_y;
-
-	string tile_type;
-	int tile_width;
-	int column_width;
-
-	bool left_right_io;
-	bool right_half;
-	bool top_half;
-
-	int bank_num;
-	int bank_tx;
-	int bank_ty;
-	int bank_xoff;
-	int bank_yoff;
-
-	CramIndexConverter(const FpgaConfig *fpga, int tile_x, int tile_y);
-	void get_cram_index(int bit_x, int bit_y, int &cram_bank, int &cram_x, int &cram_y) const;
-};
-
-struct BramIndexConverter
-{
-	const FpgaConfig *fpga;
-	int tile_x, tile_y;
-
-	int bank_num;
-	int bank_off;
-
-	BramIndexConverter(const FpgaConfig *fpga, int tile_x, int tile_y);
-	void get_bram_index(int bit_x, int bit_y, int &bram_bank, int &bram_x, int &bram_y) const;
-};
+	free(ptr);
+}
 
-static void update_crc16(uint16_t &crc, uint8_t byte)
+void operator delete[](void *ptr) noexcept
 {
-	// CRC-16-CCITT, Initialize to 0xFFFF, No zero padding
-	for (int i = 7; i >= 0; i--) {
-		uint16_t xor_value = ((crc >> 15) ^ ((byte >> i) & 1)) ? 0x1021 : 0;
-		crc = (crc << 1) ^ xor_value;
-	}
+	free(ptr);
 }
 
-static uint8_t read_byte(std::istream &ifs, uint16_t &crc_value, int &file_offset)
+void operator delete(void *ptr, size_t) noexcept
 {
-	int byte = ifs.get();
-
-	if (byte < 0)
-		error("Unexpected end of file.\n");
-
-	file_offset++;
-	update_crc16(crc_value, byte);
-
-	return byte;
+	free(ptr);
 }
 
-static void write_byte(std::ostream &ofs, uint16_t &crc_value, int &file_offset, uint8_t byte)
+void operator delete[](void *ptr, size_t) noexcept
 {
-	ofs << byte;
-	file_offset++;
-	update_crc16(crc_value, byte);
+	free(ptr);
 }
 
-void FpgaConfig::read_bits(std::istream &ifs)
+static void count_bits_set(const FpgaConfig &fpga_config)
 {
-	int file_offset = 0;
-	uint16_t crc_value = 0;
+	if (!stats_enabled)
+		return;
 
-	debug("## %s\n", __PRETTY_FUNCTION__);
-	info("Parsing bitstream file..\n");
+	uint64_t bits_set = 0;
+	for (auto planes : { &fpga_config.cram, &fpga_config.bram })
+		for (auto &plane : *planes)
+			for (uint8_t byte : plane.data)
+				bits_set += __builtin_popcount(byte);
 
-	// skip initial comments until preamble is found
+	stat_add(COUNTER_BITS_SET, bits_set);
+}
 
-	uint32_t preamble = 0;
+// prints/writes the reports when main returns (but not on errors). This runs
+// in a destructor, so a stats file that cannot be written is only reported.
+struct StatsReport
+{
+	bool summary = false;
+	string json_file;
 
-	while (1)
+	~StatsReport()
 	{
-		uint8_t byte = read_byte(ifs, crc_value, file_offset);
-		preamble = (preamble << 8) | byte;
-		if (preamble == 0xffffffff)
-			error("No preamble found in bitstream.\n");
-		if (preamble == 0x7EAA997E) {
-			info("Found preamble at offset %d.\n", file_offset-4);
-			break;
+		if (summary)
+			write_stats_summary(stderr);
+
+		if (!json_file.empty()) {
+			FILE *f = fopen(json_file.c_str(), "w");
+			if (f == nullptr) {
+				fprintf(stderr, "Error: Failed to open stats file '%s'.\n", json_file.c_str());
+				return;
+			}
+			write_stats_json(f);
+			fclose(f);
 		}
-		initblop.push_back(byte);
 	}
+};
 
-	initblop.pop_back();
-	initblop.pop_back();
-	initblop.pop_back();
-
-	// main parser loop
-
-	int current_bank = 0;
-	int current_width = 0;
-	int current_height = 0;
-	int current_offset = 0;
-	bool wakeup = false;
-
-	this->cram_width = 0;
-	this->cram_height = 0;
-
-	this->bram_width = 0;
-	this->bram_height = 0;
-
-	while (!wakeup)
-	{
-		// one command byte. the lower 4 bits of the command byte specify
-		// the length of the command payload.
-		
-		uint8_t command = read_byte(ifs, crc_value, file_offset);
-		uint32_t payload = 0;
-
-		for (int i = 0; i < (command & 0x0f); i++)
-			payload = (payload << 8) | read_byte(ifs, crc_value, file_offset);
-
-		debug("Next command at offset %d: 0x%02x 0x%0*x\n", file_offset - 1 - (command & 0x0f),
-				command, 2*(command & 0x0f), payload);
-
-		uint16_t end_token;
-
-		switch (command & 0xf0)
-		{
-		case 0x00:
-			switch (payload)
-			{
-			case 0x01:
-				info("CRAM Data [%d]: %d x %d bits = %d bits = %d bytes\n",
-						current_bank, current_width, current_height,
-						current_height*current_width, (current_height*current_width)/8);
-
-				this->cram_width = std::max(this->cram_width, current_width);
-				this->cram_height = std::max(this->cram_height, current_offset + current_height);
-
-				this->cram.resize(4);
-				this->cram[current_bank].resize(this->cram_width);
-				for (int x = 0; x < current_width; x++)
-					this->cram[current_bank][x].resize(this->cram_height);
-
-				for (int i = 0; i < (current_height*current_width)/8; i++) {
-					uint8_t byte = read_byte(ifs, crc_value, file_offset);
-					for (int j = 0; j < 8; j++) {
-						int x = (i*8 + j) % current_width;
-						int y = (i*8 + j) / current_width + current_offset;
-						this->cram[current_bank][x][y] = ((byte << j) & 0x80) != 0;
-					}
-				}
-
-				end_token = read_byte(ifs, crc_value, file_offset);
-				end_token = (end_token << 8) | read_byte(ifs, crc_value, file_offset);
-				if (end_token)
-					error("Expeded 0x0000 after CRAM data, got 0x%04x\n", end_token);
-				break;
-
-			case 0x03:
-				info("BRAM Data [%d]: %d x %d bits = %d bits = %d bytes\n",
-						current_bank, current_width, current_height,
-						current_height*current_width, (current_height*current_width)/8);
-
-				this->bram_width = std::max(this->bram_width, current_width);
-				this->bram_height = std::max(this->bram_height, current_offset + current_height);
-
-				this->bram.resize(4);
-				this->bram[current_bank].resize(this->bram_width);
-				for (int x = 0; x < current_width; x++)
-					this->bram[current_bank][x].resize(this->bram_height);
-
-				for (int i = 0; i < (current_height*current_width)/8; i++) {
-					uint8_t byte = read_byte(ifs, crc_value, file_offset);
-					for (int j = 0; j < 8; j++) {
-						int x = (i*8 + j) % current_width;
-						int y = (i*8 + j) / current_width + current_offset;
-						this->bram[current_bank][x][y] = ((byte << j) & 0x80) != 0;
-					}
-				}
-
-				end_token = read_byte(ifs, crc_value, file_offset);
-				end_token = (end_token << 8) | read_byte(ifs, crc_value, file_offset);
-				if (end_token)
-					error("Expeded 0x0000 after BRAM data, got 0x%04x\n", end_token);
-				break;
-
-			case 0x05:
-				debug("Resetting CRC.\n");
-				crc_value = 0xffff;
-				break;
-
-			case 0x06:
-				info("Wakeup.\n");
-				wakeup = true;
-				break;
-
-			default:
-				error("Unknown command: 0x%02x 0x%02x\n", command, payload);
-			}
-			break;
-
-		case 0x10:
-			current_bank = payload;
-			debug("Set bank to %d.\n", current_bank);
-			break;
-
-		case 0x20:
-			if (crc_value != 0)
-				error("CRC Check FAILED.\n");
-			info("CRC Check OK.\n");
-			break;
-
-		case 0x50:
-			if (payload == 0)
-				this->freqrange = "low";
-			else if (payload == 1)
-				this->freqrange = "medium";
-			else if (payload == 2)
-				this->freqrange = "high";
-			else
-				error("Unknown freqrange payload 0x%02x\n", payload);
-			info("Setting freqrange to '%s'.\n", this->freqrange.c_str());
-			break;
-
-		case 0x60:
-			current_width = payload + 1;
-			debug("Setting bank width to %d.\n", current_width);
-			break;
-
-		case 0x70:
-			current_height = payload;
-			debug("Setting bank height to %d.\n", current_height);
-			break;
-
-		case 0x80:
-			current_offset = payload;
-			debug("Setting bank offset to %d.\n", current_offset);
-			break;
-
-		case 0x90:
-			if (payload == 0)
-				this->warmboot = "disabled";
-			else if (payload == 32)
-				this->warmboot = "enabled";
-			else
-				error("Unknown warmboot payload 0x%02x\n", payload);
-			info("Setting warmboot to '%s'.\n", this->warmboot.c_str());
-			break;
+// ==================================================================
+// Input and output
 
-		default:
-			error("Unknown command: 0x%02x 0x%02x\n", command, payload);
-		}
-	}
+// Pack mode reads .asc files and writes bitstreams, unpack mode the other way
+// round. Binary config files are accepted as input in both modes and written
+// instead of the normal output with -C.
+//
+// Regular input files are mapped into memory and parsed in place. stdin,
+// pipes and other files that cannot be mapped are read as streams.
 
-	if (this->cram_width == 182 && this->cram_height == 80)
-		this->device = "384";
-	else if (this->cram_width == 332 && this->cram_height == 144)
-		this->device = "1k";
-	else if (this->cram_width == 872 && this->cram_height == 272)
-		this->device = "8k";
+static void read_input(FpgaConfig &fpga_config, std::istream &ifs, bool unpack_mode)
+{
+	if (FpgaConfig::is_binary(ifs))
+		fpga_config.read_binary(ifs);
+	else if (unpack_mode)
+		fpga_config.read_bits(ifs);
 	else
-		error("Failed to detect chip type.\n");
-	
-	info("Chip type is '%s'.\n", this->device.c_str());
+		fpga_config.read_ascii(ifs);
 }
 
-void FpgaConfig::write_bits(std::ostream &ofs) const
+static void read_input(FpgaConfig &fpga_config, const uint8_t *data, size_t len, bool unpack_mode)
 {
-	int file_offset = 0;
-	uint16_t crc_value = 0;
-
-	debug("## %s\n", __PRETTY_FUNCTION__);
-	info("Writing bitstream file..\n");
-
-	for (auto byte : this->initblop)
-		ofs << byte;
-
-	debug("Writing preamble.\n");
-	write_byte(ofs, crc_value, file_offset, 0x7E);
-	write_byte(ofs, crc_value, file_offset, 0xAA);
-	write_byte(ofs, crc_value, file_offset, 0x99);
-	write_byte(ofs, crc_value, file_offset, 0x7E);
-
-	debug("Setting freqrange to '%s'.\n", this->freqrange.c_str());
-	write_byte(ofs, crc_value, file_offset, 0x51);
-	if (this->freqrange == "low")
-		write_byte(ofs, crc_value, file_offset, 0x00);
-	else if (this->freqrange == "medium")
-		write_byte(ofs, crc_value, file_offset, 0x01);
-	else if (this->freqrange == "high")
-		write_byte(ofs, crc_value, file_offset, 0x02);
+	if (FpgaConfig::is_binary(data, len))
+		fpga_config.read_binary(data, len);
+	else if (unpack_mode)
+		fpga_config.read_bits(data, len);
 	else
-		error("Unknown freqrange '%s'.\n", this->freqrange.c_str());
-
-	debug("Resetting CRC.\n");
-	write_byte(ofs, crc_value, file_offset, 0x01);
-	write_byte(ofs, crc_value, file_offset, 0x05);
-	crc_value = 0xffff;
-
-	debug("Setting warmboot to '%s'.\n", this->warmboot.c_str());
-	write_byte(ofs, crc_value, file_offset, 0x92);
-	write_byte(ofs, crc_value, file_offset, 0x00);
-	if (this->warmboot == "disabled")
-		write_byte(ofs, crc_value, file_offset, 0x00);
-	else if (this->warmboot == "enabled")
-		write_byte(ofs, crc_value, file_offset, 0x20);
-	else
-		error("Unknown warmboot setting '%s'.\n", this->warmboot.c_str());
-
-	debug("CRAM: Setting bank width to %d.\n", this->cram_width);
-	write_byte(ofs, crc_value, file_offset, 0x62);
-	write_byte(ofs, crc_value, file_offset, (this->cram_width-1) >> 8);
-	write_byte(ofs, crc_value, file_offset, (this->cram_width-1));
-
-	debug("CRAM: Setting bank height to %d.\n", this->cram_height);
-	write_byte(ofs, crc_value, file_offset, 0x72);
-	write_byte(ofs, crc_value, file_offset, this->cram_height >> 8);
-	write_byte(ofs, crc_value, file_offset, this->cram_height);
-
-	debug("CRAM: Setting bank offset to 0.\n");
-	write_byte(ofs, crc_value, file_offset, 0x82);
-	write_byte(ofs, crc_value, file_offset, 0x00);
-	write_byte(ofs, crc_value, file_offset, 0x00);
-
-	for (int cram_bank = 0; cram_bank < 4; cram_bank++)
-	{
-		vector<bool> cram_bits;
-		for (int cram_y = 0; cram_y < this->cram_height; cram_y++)
-		for (int cram_x = 0; cram_x < this->cram_width; cram_x++)
-			cram_bits.push_back(this->cram[cram_bank][cram_x][cram_y]);
-
-		debug("CRAM: Setting bank %d.\n", cram_bank);
-		write_byte(ofs, crc_value, file_offset, 0x11);
-		write_byte(ofs, crc_value, file_offset, cram_bank);
-
-		debug("CRAM: Writing bank %d data.\n", cram_bank);
-		write_byte(ofs, crc_value, file_offset, 0x01);
-		write_byte(ofs, crc_value, file_offset, 0x01);
-		for (int i = 0; i < int(cram_bits.size()); i += 8) {
-			uint8_t byte = 0;
-			for (int j = 0; j < 8; j++)
-				byte = (byte << 1) | (cram_bits[i+j] ? 1 : 0);
-			write_byte(ofs, crc_value, file_offset, byte);
-		}
+		fpga_config.read_ascii(reinterpret_cast<const char*>(data), len);
+}
 
-		write_byte(ofs, crc_value, file_offset, 0x00);
-		write_byte(ofs, crc_value, file_offset, 0x00);
+// filename "-" is stdin
+static void read_input_file(FpgaConfig &fpga_config, const string &filename, bool unpack_mode)
+{
+	ScopedTimer timer(TIMER_READ_INPUT);
+
+	MappedFile file;
+	if (filename != "-" && file.open(filename)) {
+		debug("Mapped input file '%s' (%zu bytes).\n", filename.c_str(), file.size);
+		read_input(fpga_config, file.data, file.size, unpack_mode);
+	} else if (filename == "-") {
+		read_input(fpga_config, std::cin, unpack_mode);
+	} else {
+		std::ifstream ifs(filename, std::ios::binary);
+		if (!ifs.is_open())
+			error("Failed to open input file '%s'.\n", filename.c_str());
+		read_input(fpga_config, ifs, unpack_mode);
 	}
 
-	int bram_chunk_size = 128;
+	count_bits_set(fpga_config);
+}
 
-	if (this->bram_width && this->bram_height)
-	{
-		debug("BRAM: Setting bank width to %d.\n", this->bram_width);
-		write_byte(ofs, crc_value, file_offset, 0x62);
-		write_byte(ofs, crc_value, file_offset, (this->bram_width-1) >> 8);
-		write_byte(ofs, crc_value, file_offset, (this->bram_width-1));
-
-		debug("BRAM: Setting bank height to %d.\n", this->bram_height);
-		write_byte(ofs, crc_value, file_offset, 0x72);
-		write_byte(ofs, crc_value, file_offset, bram_chunk_size >> 8);
-		write_byte(ofs, crc_value, file_offset, bram_chunk_size);
-
-		for (int bram_bank = 0; bram_bank < 4; bram_bank++)
-		{
-			debug("BRAM: Setting bank %d.\n", bram_bank);
-			write_byte(ofs, crc_value, file_offset, 0x11);
-			write_byte(ofs, crc_value, file_offset, bram_bank);
-
-			for (int offset = 0; offset < this->bram_height; offset += bram_chunk_size)
-			{
-				vector<bool> bram_bits;
-				for (int bram_y = 0; bram_y < bram_chunk_size; bram_y++)
-				for (int bram_x = 0; bram_x < this->bram_width; bram_x++)
-					bram_bits.push_back(this->bram[bram_bank][bram_x][bram_y+offset]);
-
-				debug("BRAM: Setting bank offset to %d.\n", offset);
-				write_byte(ofs, crc_value, file_offset, 0x82);
-				write_byte(ofs, crc_value, file_offset, offset >> 8);
-				write_byte(ofs, crc_value, file_offset, offset);
-
-				debug("BRAM: Writing bank %d data.\n", bram_bank);
-				write_byte(ofs, crc_value, file_offset, 0x01);
-				write_byte(ofs, crc_value, file_offset, 0x03);
-				for (int i = 0; i < int(bram_bits.size()); i += 8) {
-					uint8_t byte = 0;
-					for (int j = 0; j < 8; j++)
-						byte = (byte << 1) | (bram_bits[i+j] ? 1 : 0);
-					write_byte(ofs, crc_value, file_offset, byte);
-				}
+static void read_input_data(const string &filename, vector<uint8_t> &data)
+{
+	ScopedTimer timer(TIMER_READ_INPUT);
 
-				write_byte(ofs, crc_value, file_offset, 0x00);
-				write_byte(ofs, crc_value, file_offset, 0x00);
-			}
-		}
+	MappedFile file;
+	if (filename != "-" && file.open(filename)) {
+		data.assign(file.data, file.data + file.size);
+		return;
 	}
 
-	debug("Writing CRC value.\n");
-	write_byte(ofs, crc_value, file_offset, 0x22);
-	uint8_t crc_hi = crc_value >> 8, crc_lo = crc_value;
-	write_byte(ofs, crc_value, file_offset, crc_hi);
-	write_byte(ofs, crc_value, file_offset, crc_lo);
-
-	debug("Wakeup.\n");
-	write_byte(ofs, crc_value, file_offset, 0x01);
-	write_byte(ofs, crc_value, file_offset, 0x06);
+	std::ifstream ifs;
+	if (filename != "-") {
+		ifs.open(filename, std::ios::binary);
+		if (!ifs.is_open())
+			error("Failed to open input file '%s'.\n", filename.c_str());
+	}
 
-	debug("Padding byte.\n");
-	write_byte(ofs, crc_value, file_offset, 0x00);
+	std::istream &is = filename == "-" ? std::cin : ifs;
+	data.assign(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
 }
 
-void FpgaConfig::read_ascii(std::istream &ifs)
+// decode a bitstream written with skip_zero_rows again and check that it
+// gives the same config
+static void verify_bits(const FpgaConfig &fpga_config, const vector<uint8_t> &data)
 {
-	debug("## %s\n", __PRETTY_FUNCTION__);
-	info("Parsing ascii file..\n");
-
-	bool got_device = false;
-	this->cram.clear();
-	this->bram.clear();
-	this->freqrange = "low";
-	this->warmboot = "enabled";
-
-	bool reuse_line = true;
-	string line, command;
-
-	while (reuse_line || getline(ifs, line))
-	{
-		reuse_line = false;
-
-		std::istringstream is(line);
-		is >> command;
-
-		if (command.empty())
-			continue;
-
-		debug("Next command: %s\n", line.c_str());
-
-		if (command == ".comment")
-		{
-			this->initblop.clear();
-			this->initblop.push_back(0xff);
-			this->initblop.push_back(0x00);
-
-			while (getline(ifs, line))
-			{
-				if (line.substr(0, 1) == ".") {
-					reuse_line = true;
-					break;
-				}
-
-				for (auto ch : line)
-					this->initblop.push_back(ch);
-				this->initblop.push_back(0);
-			}
-
-			this->initblop.push_back(0x00);
-			this->initblop.push_back(0xff);
-			continue;
-		}
-
-		if (command == ".device")
-		{
-			if (got_device)
-				error("More than one .device statement.\n");
-
-			is >> this->device;
-
-			if (this->device == "384") {
-				this->cram_width = 182;
-				this->cram_height = 80;
-				this->bram_width = 0;
-				this->bram_height = 0;
-			} else
-			if (this->device == "1k") {
-				this->cram_width = 332;
-				this->cram_height = 144;
-				this->bram_width = 64;
-				this->bram_height = 2 * 128;
-			} else
-			if (this->device == "8k") {
-				this->cram_width = 872;
-				this->cram_height = 272;
-				this->bram_width = 128;
-				this->bram_height = 2 * 128;
-			} else
-				error("Unsupported chip type '%s'.\n", this->device.c_str());
-
-			this->cram.resize(4);
-			for (int i = 0; i < 4; i++) {
-				this->cram[i].resize(this->cram_width);
-				for (int x = 0; x < this->cram_width; x++)
-					this->cram[i][x].resize(this->cram_height);
-			}
-
-			this->bram.resize(4);
-			for (int i = 0; i < 4; i++) {
-				this->bram[i].resize(this->bram_width);
-				for (int x = 0; x < this->bram_width; x++)
-					this->bram[i][x].resize(this->bram_height);
-			}
-
-			got_device = true;
-			continue;
-		}
+	FpgaConfig check;
+	check.read_bits(data.data(), data.size());
 
-		if (command == ".io_tile" || command == ".logic_tile" || command == ".ramb_tile" || command == ".ramt_tile")
-		{
-			if (!got_device)
-				error("Missing .device statement before %s.\n", command.c_str());
+	if (check.device != fpga_config.device || check.freqrange != fpga_config.freqrange ||
+			check.warmboot != fpga_config.warmboot || check.initblop != fpga_config.initblop)
+		error("Bitstream verification failed: device, options or comments differ.\n");
 
-			int tile_x, tile_y;
-			is >> tile_x >> tile_y;
+	for (int bank = 0; bank < 4; bank++)
+		if (check.cram[bank].data != fpga_config.cram[bank].data)
+			error("Bitstream verification failed: CRAM bank %d differs.\n", bank);
 
-			CramIndexConverter cic(this, tile_x, tile_y);
+	if (fpga_config.bram_width && fpga_config.bram_height)
+		for (int bank = 0; bank < 4; bank++)
+			if (check.bram[bank].data != fpga_config.bram[bank].data)
+				error("Bitstream verification failed: BRAM bank %d differs.\n", bank);
 
-			if (("." + cic.tile_type + "_tile") != command)
-				error("Got %s statement for %s tile %d %d.\n",
-						command.c_str(), cic.tile_type.c_str(), tile_x, tile_y);
-
-			for (int bit_y = 0; bit_y < 16 && getline(ifs, line); bit_y++)
-			{
-				if (line.substr(0, 1) == ".") {
-					reuse_line = true;
-					break;
-				}
-
-				for (int bit_x = 0; bit_x < int(line.size()) && bit_x < cic.tile_width; bit_x++)
-					if (line[bit_x] == '1') {
-						int cram_bank, cram_x, cram_y;
-						cic.get_cram_index(bit_x, bit_y, cram_bank, cram_x, cram_y);
-						this->cram[cram_bank][cram_x][cram_y] = true;
-					}
-			}
-
-			continue;
-		}
-
-		if (command == ".ram_data")
-		{
-			if (!got_device)
-				error("Missing .device statement before %s.\n", command.c_str());
-
-			int tile_x, tile_y;
-			is >> tile_x >> tile_y;
-
-			BramIndexConverter bic(this, tile_x, tile_y);
-
-			for (int bit_y = 0; bit_y < 16 && getline(ifs, line); bit_y++)
-			{
-				if (line.substr(0, 1) == ".") {
-					reuse_line = true;
-					break;
-				}
-
-				for (int bit_x = 256-4, ch_idx = 0; ch_idx < int(line.size()) && bit_x >= 0; bit_x -= 4, ch_idx++)
-				{
-					int value = -1;
-					if ('0' <= line[ch_idx] && line[ch_idx] <= '9')
-						value = line[ch_idx] - '0';
-					if ('a' <= line[ch_idx] && line[ch_idx] <= 'f')
-						value = line[ch_idx] - 'a' + 10;
-					if ('A' <= line[ch_idx] && line[ch_idx] <= 'F')
-						value = line[ch_idx] - 'A' + 10;
-					if (value < 0)
-						error("Not a hex character: '%c' (in line '%s')\n", line[ch_idx], line.c_str());
-
-					for (int i = 0; i < 4; i++)
-						if ((value & (1 << i)) != 0) {
-							int bram_bank, bram_x, bram_y;
-							bic.get_bram_index(bit_x+i, bit_y, bram_bank, bram_x, bram_y);
-							this->bram[bram_bank][bram_x][bram_y] = true;
-						}
-				}
-			}
+	info("Bitstream verified.\n");
+}
 
-			continue;
-		}
+static void write_output(const FpgaConfig &fpga_config, std::ostream &ofs, bool unpack_mode, bool binary_output,
+		int num_threads = 1, bool skip_zero_rows = false)
+{
+	if (binary_output) {
+		fpga_config.write_binary(ofs);
+	} else if (unpack_mode) {
+		fpga_config.write_ascii(ofs, num_threads);
+	} else if (skip_zero_rows) {
+		vector<uint8_t> data;
+		fpga_config.write_bits(data, true);
+		verify_bits(fpga_config, data);
+
+		ScopedTimer timer(TIMER_WRITE_OUTPUT);
+		ofs.write(reinterpret_cast<const char*>(data.data()), data.size());
+		stat_add(COUNTER_BYTES_WRITTEN, data.size());
+	} else {
+		fpga_config.write_bits(ofs);
+	}
+}
 
-		if (command == ".extra_bit")
-		{
-			if (!got_device)
-				error("Missing .device statement before %s.\n", command.c_str());
+// ==================================================================
+// Edit files
 
-			int cram_bank, cram_x, cram_y;
-			is >> cram_bank >> cram_x >> cram_y;
-			this->cram[cram_bank][cram_x][cram_y] = true;
+// Edit files for -e use the notation of .asc files and of the -D output:
+//
+//   .logic_tile 5 7     selects a tile (any .*_tile statement)
+//   B2[10] 1            sets (1) or clears (0) a config bit of the tile
+//   .ram_data 8 3       selects the ram data of a ramb tile
+//   B1[232] 0           sets or clears a single ram data bit, or ..
+//   0123..cdef          .. replaces the next row (64 hex digits)
+//   .extra_bit 1 200 5 1        sets a CRAM bank bit (bank, x, y, value)
+//   .extra_bram_bit 0 3 9 1     sets a BRAM bank bit
+//
+// Lines with two values ("B2[10] 0 1" in the -D output) use the last one.
+// Whether tiles and bits exist on the device is checked when patching.
 
-			continue;
-		}
-		
-		if (command == ".sym")
-		  continue;
-		
-		if (command.substr(0, 1) == ".")
-			error("Unknown statement: %s\n", command.c_str());
-		error("Unexpected data line: %s\n", line.c_str());
-	}
+// non-negative decimal number in an edit file, with the line for the error
+static int edit_number(const string &word, const string &filename, int line_nr, const string &line)
+{
+	char *end = nullptr;
+	errno = 0;
+	long value = isdigit((unsigned char)word.c_str()[0]) ? strtol(word.c_str(), &end, 10) : -1;
+	if (value < 0 || *end != 0 || errno == ERANGE || value > INT_MAX)
+		error("Invalid number '%s' in line %d of '%s': %s\n", word.c_str(), line_nr, filename.c_str(), line.c_str());
+	return value;
 }
 
-void FpgaConfig::write_ascii(std::ostream &ofs) const
+static void read_edit_file(const string &filename, vector<BitEdit> &edits)
 {
-	debug("## %s\n", __PRETTY_FUNCTION__);
-	info("Writing ascii file..\n");
-
-	ofs << ".comment";
-	bool insert_newline = true;
-	for (auto ch : this->initblop) {
-		if (ch == 0) {
-			insert_newline = true;
-		} else if (ch == 0xff) {
-			insert_newline = false;
-		} else {
-			if (insert_newline)
-				ofs << '\n';
-			ofs << ch;
-			insert_newline = false;
-		}
-	}
+	std::ifstream ifs(filename);
+	if (!ifs.is_open())
+		error("Failed to open edit file '%s'.\n", filename.c_str());
 
-	ofs << stringf("\n.device %s\n", this->device.c_str());
+	bool have_tile = false, bram = false;
+	int tile_x = 0, tile_y = 0, row = 0;
 
-	typedef std::tuple<int, int, int> tile_bit_t;
-	std::set<tile_bit_t> tile_bits;
-
-	for (int y = 0; y <= this->chip_height()+1; y++)
-	for (int x = 0; x <= this->chip_width()+1; x++)
+	string line;
+	for (int line_nr = 1; getline(ifs, line); line_nr++)
 	{
-		CramIndexConverter cic(this, x, y);
+		std::istringstream is(line);
+		vector<string> words;
+		for (string word; is >> word;)
+			words.push_back(word);
 
-		if (cic.tile_type == "corner")
+		if (words.empty() || words[0][0] == '#')
 			continue;
 
-		ofs << stringf(".%s_tile %d %d\n", cic.tile_type.c_str(), x, y);
-
-		for (int bit_y = 0; bit_y < 16; bit_y++) {
-			for (int bit_x = 0; bit_x < cic.tile_width; bit_x++) {
-				int cram_bank, cram_x, cram_y;
-				cic.get_cram_index(bit_x, bit_y, cram_bank, cram_x, cram_y);
-				tile_bits.insert(tile_bit_t(cram_bank, cram_x, cram_y));
-				ofs << (this->cram[cram_bank][cram_x][cram_y] ? '1' : '0');
-			}
-			ofs << '\n';
-		}
-
-		if (cic.tile_type == "ramb")
-		{
-			BramIndexConverter bic(this, x, y);
-			ofs << stringf(".ram_data %d %d\n", x, y);
-
-			for (int bit_y = 0; bit_y < 16; bit_y++) {
-				for (int bit_x = 256-4; bit_x >= 0; bit_x -= 4) {
-					int value = 0;
-					for (int i = 0; i < 4; i++) {
-						int bram_bank, bram_x, bram_y;
-						bic.get_bram_index(bit_x+i, bit_y, bram_bank, bram_x, bram_y);
-						if (this->bram[bram_bank][bram_x][bram_y])
-							value += 1 << i;
-					}
-					ofs << "0123456789abcdef"[value];
+		const string &cmd = words[0];
+		auto number = [&](const string &word) {
+			return edit_number(word, filename, line_nr, line);
+		};
+
+		if ((cmd == ".extra_bit" || cmd == ".extra_bram_bit") && (words.size() == 5 || words.size() == 6)) {
+			BitEdit edit = { cmd == ".extra_bit" ? BitEdit::CRAM_BIT : BitEdit::BRAM_BIT, 0, 0,
+					number(words[1]), number(words[2]), number(words[3]), words.back() == "1" };
+			if (words.back() != "0" && words.back() != "1")
+				error("Invalid bit value in line %d of '%s': %s\n", line_nr, filename.c_str(), line.c_str());
+			edits.push_back(edit);
+		} else if (cmd[0] == '.' && words.size() == 3 && (cmd == ".ram_data" || (cmd.size() > 5 && cmd.substr(cmd.size()-5) == "_tile"))) {
+			have_tile = true;
+			bram = cmd == ".ram_data";
+			tile_x = number(words[1]);
+			tile_y = number(words[2]);
+			row = 0;
+		} else if (have_tile && cmd[0] == 'B' && (words.size() == 2 || words.size() == 3) &&
+				cmd.find('[') != string::npos && cmd.back() == ']') {
+			size_t open = cmd.find('[');
+			int bit_y = number(cmd.substr(1, open - 1));
+			int bit_x = number(cmd.substr(open + 1, cmd.size() - open - 2));
+			BitEdit edit = { bram ? BitEdit::RAM_DATA_BIT : BitEdit::TILE_BIT, tile_x, tile_y, 0, bit_x, bit_y, words.back() == "1" };
+			if (words.back() != "0" && words.back() != "1")
+				error("Invalid bit value in line %d of '%s': %s\n", line_nr, filename.c_str(), line.c_str());
+			edits.push_back(edit);
+		} else if (have_tile && bram && words.size() == 1 && cmd.size() == 64 &&
+				cmd.find_first_not_of("0123456789abcdefABCDEF") == string::npos) {
+			for (int i = 0; i < 64; i++) {
+				int value = isdigit(cmd[i]) ? cmd[i] - '0' : tolower(cmd[i]) - 'a' + 10;
+				for (int k = 0; k < 4; k++) {
+					BitEdit edit = { BitEdit::RAM_DATA_BIT, tile_x, tile_y, 0, 252 - 4*i + k, row, ((value >> k) & 1) != 0 };
+					edits.push_back(edit);
 				}
-				ofs << '\n';
 			}
-		}
-	}
-
-	for (int i = 0; i < 4; i++)
-	for (int x = 0; x < this->cram_width; x++)
-	for (int y = 0; y < this->cram_height; y++)
-		if (this->cram[i][x][y] && tile_bits.count(tile_bit_t(i, x, y)) == 0)
-			ofs << stringf(".extra_bit %d %d %d\n", i, x, y);
-
-#if 0
-	for (int i = 0; i < 4; i++) {
-		ofs << stringf(".bram_bank %d\n", i);
-		for (int x = 0; x < this->bram_width; x++) {
-			for (int y = 0; y < this->bram_height; y += 4)
-				ofs << "0123456789abcdef"[(this->bram[i][x][y] ? 1 : 0) + (this->bram[i][x][y+1] ? 2 : 0) +
-						(this->bram[i][x][y+2] ? 4 : 0) + (this->bram[i][x][y+3] ? 8 : 0)];
-			ofs << '\n';
-		}
-	}
-#endif
-}
-
-void FpgaConfig::write_cram_pbm(std::ostream &ofs, int bank_num) const
-{
-	debug("## %s\n", __PRETTY_FUNCTION__);
-	info("Writing cram pbm file..\n");
-
-	ofs << "P1\n";
-	ofs << stringf("%d %d\n", 2*this->cram_width, 2*this->cram_height);
-	for (int y = 2*this->cram_height-1; y >= 0; y--) {
-		for (int x = 0; x < 2*this->cram_width; x++) {
-			int bank = 0, bank_x = x, bank_y = y;
-			if (bank_x >= this->cram_width)
-				bank |= 1, bank_x = 2*this->cram_width - bank_x - 1;
-			if (bank_y >= this->cram_height)
-				bank |= 2, bank_y = 2*this->cram_height - bank_y - 1;
-			if (bank_num >= 0 && bank != bank_num)
-				ofs << " 0";
-			else
-				ofs << (this->cram[bank][bank_x][bank_y] ? " 1" : " 0");
-		}
-		ofs << '\n';
-	}
-}
-
-void FpgaConfig::write_bram_pbm(std::ostream &ofs, int bank_num) const
-{
-	debug("## %s\n", __PRETTY_FUNCTION__);
-	info("Writing bram pbm file..\n");
-
-	ofs << "P1\n";
-	ofs << stringf("%d %d\n", 2*this->bram_width, 2*this->bram_height);
-	for (int y = 2*this->bram_height-1; y >= 0; y--) {
-		for (int x = 0; x < 2*this->bram_width; x++) {
-			int bank = 0, bank_x = x, bank_y = y;
-			if (bank_x >= this->bram_width)
-				bank |= 1, bank_x = 2*this->bram_width - bank_x - 1;
-			if (bank_y >= this->bram_height)
-				bank |= 2, bank_y = 2*this->bram_height - bank_y - 1;
-			if (bank_num >= 0 && bank != bank_num)
-				ofs << " 0";
-			else
-				ofs << (this->bram[bank][bank_x][bank_y] ? " 1" : " 0");
-		}
-		ofs << '\n';
+			row++;
+		} else
+			error("Invalid edit in line %d of '%s': %s\n", line_nr, filename.c_str(), line.c_str());
 	}
 }
 
-int FpgaConfig::chip_width() const
-{
-	if (this->device == "384") return 6;
-	if (this->device == "1k") return 12;
-	if (this->device == "8k") return 32;
-	panic("Unknown chip type '%s'.\n", this->device.c_str());
-}
+// ==================================================================
+// Batch mode
 
-int FpgaConfig::chip_height() const
+struct BatchJob
 {
-	if (this->device == "384") return 8;
-	if (this->device == "1k") return 16;
-	if (this->device == "8k") return 32;
-	panic("Unknown chip type '%s'.\n", this->device.c_str());
-}
+	bool unpack_mode;
+	bool binary_output;
+	bool skip_zero_rows;
+	string input_file, output_file;
 
-vector<int> FpgaConfig::chip_cols() const
-{
-	if (this->device == "384") return vector<int>({18, 54, 54, 54, 54});
-	if (this->device == "1k") return vector<int>({18, 54, 54, 42, 54, 54, 54});
-	if (this->device == "8k") return vector<int>({18, 54, 54, 54, 54, 54, 54, 54, 42, 54, 54, 54, 54, 54, 54, 54, 54});
-	panic("Unknown chip type '%s'.\n", this->device.c_str());
-}
+	bool ok = false;
+	double seconds = 0;
+};
 
-string FpgaConfig::tile_type(int x, int y) const
+// Each non-empty line of the job file that does not start with '#' is
+// "[-u] [-C] [-z] input-file output-file". Without the options the defaults
+// from the command line are used.
+static void read_batch_file(const string &filename, bool unpack_mode, bool binary_output, bool skip_zero_rows,
+		vector<BatchJob> &jobs)
 {
-	if ((x == 0 || x == this->chip_width()+1) && (y == 0 || y == this->chip_height()+1)) return "corner";
-	if ((x == 0 || x == this->chip_width()+1) || (y == 0 || y == this->chip_height()+1)) return "io";
+	std::ifstream ifs(filename);
+	if (!ifs.is_open())
+		error("Failed to open job file '%s'.\n", filename.c_str());
 
-	if (this->device == "384") return "logic";
-
-	if (this->device == "1k") {
-		if (x == 3 || x == 10) return y % 2 == 1 ? "ramb" : "ramt";
-		return "logic";
-	}
-
-	if (this->device == "8k") {
-		if (x == 8 || x == 25) return y % 2 == 1 ? "ramb" : "ramt";
-		return "logic";
-	}
-
-	panic("Unknown chip type '%s'.\n", this->device.c_str());
-}
-
-int FpgaConfig::tile_width(const string &type) const
-{
-	if (type == "corner") return 0;
-	if (type == "logic")  return 54;
-	if (type == "ramb")   return 42;
-	if (type == "ramt")   return 42;
-	if (type == "io")     return 18;
-	panic("Unknown tile type '%s'.\n", type.c_str());
-}
+	string line;
+	for (int line_nr = 1; getline(ifs, line); line_nr++)
+	{
+		std::istringstream is(line);
+		vector<string> words;
+		for (string word; is >> word;)
+			words.push_back(word);
 
-void FpgaConfig::cram_clear()
-{
-	for (int i = 0; i < 4; i++)
-	for (int x = 0; x < this->cram_width; x++)
-	for (int y = 0; y < this->cram_height; y++)
-		this->cram[i][x][y] = false;
-}
+		if (words.empty() || words[0][0] == '#')
+			continue;
 
-void FpgaConfig::cram_fill_tiles()
-{
-	for (int y = 0; y <= this->chip_height()+1; y++)
-	for (int x = 0; x <= this->chip_width()+1; x++)
-	{
-		CramIndexConverter cic(this, x, y);
+		BatchJob job;
+		job.unpack_mode = unpack_mode;
+		job.binary_output = binary_output;
+		job.skip_zero_rows = skip_zero_rows;
 
-		for (int bit_y = 0; bit_y < 16; bit_y++)
-		for (int bit_x = 0; bit_x < cic.tile_width; bit_x++) {
-			int cram_bank, cram_x, cram_y;
-			cic.get_cram_index(bit_x, bit_y, cram_bank, cram_x, cram_y);
-			this->cram[cram_bank][cram_x][cram_y] = true;
+		while (!words.empty() && (words[0] == "-u" || words[0] == "-C" || words[0] == "-z")) {
+			if (words[0] == "-u")
+				job.unpack_mode = true;
+			else if (words[0] == "-C")
+				job.binary_output = true;
+			else
+				job.skip_zero_rows = true;
+			words.erase(words.begin());
 		}
-	}
-}
 
-void FpgaConfig::cram_checkerboard(int m)
-{
-	for (int y = 0; y <= this->chip_height()+1; y++)
-	for (int x = 0; x <= this->chip_width()+1; x++)
-	{
-		if ((x+y) % 2 == m)
-			continue;
-			
-		CramIndexConverter cic(this, x, y);
-
-		for (int bit_y = 0; bit_y < 16; bit_y++)
-		for (int bit_x = 0; bit_x < cic.tile_width; bit_x++) {
-			int cram_bank, cram_x, cram_y;
-			cic.get_cram_index(bit_x, bit_y, cram_bank, cram_x, cram_y);
-			this->cram[cram_bank][cram_x][cram_y] = true;
-		}
+		if (words.size() != 2)
+			error("Invalid job in line %d of '%s': %s\n", line_nr, filename.c_str(), line.c_str());
+
+		job.input_file = words[0];
+		job.output_file = words[1];
+		jobs.push_back(job);
 	}
 }
 
-CramIndexConverter::CramIndexConverter(const FpgaConfig *fpga, int tile_x, int tile_y)
+static void run_batch_job(BatchJob &job, int num_threads)
 {
-	this->fpga = fpga;
-	this->tile_x = tile_x;
-	this->tile_y = tile_y;
-
+	auto start_time = std::chrono::steady_clock::now();
+	errors_throw = true;
 
-	this->tile_type = fpga->tile_type(this->tile_x, this->tile_y);
-	this->tile_width = fpga->tile_width(this->tile_type);
+	try {
+		FpgaConfig fpga_config;
+		read_input_file(fpga_config, job.input_file, job.unpack_mode);
 
-	auto chip_width = fpga->chip_width();
-	auto chip_height = fpga->chip_height();
-	auto chip_cols = fpga->chip_cols();
-
-	this->left_right_io = this->tile_x == 0 || this->tile_x == chip_width+1;
-	this->right_half = this->tile_x > chip_width / 2;
-	this->top_half = this->tile_y > chip_height / 2;
+		std::ofstream ofs(job.output_file, std::ios::binary);
+		if (!ofs.is_open())
+			error("Failed to open output file '%s'.\n", job.output_file.c_str());
 
-	this->bank_num = 0;
-	if (this->top_half) this->bank_num |= 1;
-	if (this->right_half) this->bank_num |= 2;
+		write_output(fpga_config, ofs, job.unpack_mode, job.binary_output, num_threads, job.skip_zero_rows);
 
-	this->bank_tx = this->right_half ? chip_width  + 1 - this->tile_x : this->tile_x;
-	this->bank_ty = this->top_half   ? chip_height + 1 - this->tile_y : this->tile_y;
+		ofs.close();
+		if (ofs.fail())
+			error("Failed to write output file '%s'.\n", job.output_file.c_str());
 
-	this->bank_xoff = 0;
-	for (int i = 0; i < this->bank_tx; i++)
-		this->bank_xoff += chip_cols.at(i);
+		job.ok = true;
+	} catch (ErrorException &e) {
+		log("Job %s -> %s: %s", job.input_file.c_str(), job.output_file.c_str(), e.message.c_str());
+		job.ok = false;
+	}
 
-	this->bank_yoff = 16 * this->bank_ty;
+	errors_throw = false;
 
-	this->column_width = chip_cols.at(this->bank_tx);
+	job.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
 }
 
-void CramIndexConverter::get_cram_index(int bit_x, int bit_y, int &cram_bank, int &cram_x, int &cram_y) const
+// the jobs run on up to num_threads threads, threads left over when there
+// are fewer jobs are used by write_ascii within the jobs
+static int run_batch(vector<BatchJob> &jobs, int num_threads)
 {
-	static const int io_top_bottom_permx[18] = {23, 25, 26, 27, 16, 17, 18, 19, 20, 14, 32, 33, 34, 35, 36, 37, 4, 5};
-	static const int io_top_bottom_permy[16] = {0, 1, 3, 2, 4, 5, 7, 6, 8, 9, 11, 10, 12, 13, 15, 14};
+	auto start_time = std::chrono::steady_clock::now();
+	int ascii_threads = std::max(1, num_threads / std::max(1, int(jobs.size())));
 
-	cram_bank = bank_num;
+	parallel_for(jobs.size(), num_threads, [&](int i) {
+		info("Job %d: %s -> %s\n", i+1, jobs[i].input_file.c_str(), jobs[i].output_file.c_str());
+		run_batch_job(jobs[i], ascii_threads);
+	});
 
-	if (tile_type == "io")
-	{
-		if (left_right_io)
-		{
-			cram_x = bank_xoff + column_width - 1 - bit_x;
+	double wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
 
-			if (top_half)
-				cram_y = bank_yoff + 15 - bit_y;
-			else
-				cram_y = bank_yoff + bit_y;
-		}
-		else
-		{
-			cram_y = bank_yoff + 15 - io_top_bottom_permy[bit_y];
+	int num_failed = 0;
+	double job_seconds = 0;
 
-			if (right_half)
-				cram_x = bank_xoff + column_width - 1 - io_top_bottom_permx[bit_x];
-			else
-				cram_x = bank_xoff + io_top_bottom_permx[bit_x];
-		}
-	}
-	else
-	{
-		if (right_half)
-			cram_x = bank_xoff + column_width - 1 - bit_x;
-		else
-			cram_x = bank_xoff + bit_x;
-		
-		if (top_half)
-			cram_y = bank_yoff + (15 - bit_y);
-		else
-			cram_y = bank_yoff + bit_y;
+	log("\n");
+	for (int i = 0; i < int(jobs.size()); i++) {
+		auto &job = jobs[i];
+		log("[%4d] %-4s %10.3f ms  %-6s %s -> %s\n", i+1, job.ok ? "OK" : "FAIL", 1e3 * job.seconds,
+				job.unpack_mode ? "unpack" : "pack", job.input_file.c_str(), job.output_file.c_str());
+		num_failed += !job.ok;
+		job_seconds += job.seconds;
 	}
-}
-
-BramIndexConverter::BramIndexConverter(const FpgaConfig *fpga, int tile_x, int tile_y)
-{
-	this->fpga = fpga;
-	this->tile_x = tile_x;
-	this->tile_y = tile_y;
 
-	auto chip_width = fpga->chip_width();
-	auto chip_height = fpga->chip_height();
+	log("\n%d jobs, %d failed, %.3f ms job time, %.3f ms wall time on %d threads.\n",
+			int(jobs.size()), num_failed, 1e3 * job_seconds, 1e3 * wall_seconds, num_threads);
 
-	bool right_half = this->tile_x > chip_width / 2;
-	bool top_half = this->tile_y > chip_height / 2;
-
-	this->bank_num = 0;
-	if (top_half) this->bank_num |= 1;
-	if (right_half) this->bank_num |= 2;
-
-	this->bank_off = 16 * ((top_half ? this->tile_y - chip_height / 2 : this->tile_y - 1) / 2);
+	return num_failed ? 1 : 0;
 }
 
-void BramIndexConverter::get_bram_index(int bit_x, int bit_y, int &bram_bank, int &bram_x, int &bram_y) const
-{
-	int index = 256 * bit_y + (16*(bit_x/16) + 15 - bit_x%16);
-	bram_bank = bank_num;
-	bram_x = bank_off + index % 16;
-	bram_y = index / 16;
-}
-
-
 // ==================================================================
 // Main program
 
@@ -1094,9 +467,51 @@ void usage()
 	log("    -r\n");
 	log("        write bram data, not cram, to the netpbm file\n");
 	log("\n");
+	log("    -C\n");
+	log("        write a compact binary config file instead of the bitstream or\n");
+	log("        ascii file. binary config files are accepted as input in both modes.\n");
+	log("\n");
+	log("    -z\n");
+	log("        leave the all-zero rows of the CRAM and BRAM banks out of the\n");
+	log("        bitstream. the bitstream is decoded again to check that it gives\n");
+	log("        the same config.\n");
+	log("\n");
 	log("    -B0, -B1, -B2, -B3\n");
 	log("        only include the specified bank in the netpbm file\n");
 	log("\n");
+	log("    -p\n");
+	log("        write the netpbm file in binary (P4) instead of ascii (P1) format\n");
+	log("\n");
+	log("    -T\n");
+	log("        print the time spent in each phase and event counters (bytes\n");
+	log("        decoded, bits set, tiles emitted, allocations, ..) when done\n");
+	log("\n");
+	log("    -J <stats_file>\n");
+	log("        write the same timers and counters to a JSON file\n");
+	log("\n");
+	log("    -D <file_a> <file_b>\n");
+	log("        diff mode: compare two bitstreams (or binary config files) and\n");
+	log("        print the differing bits tile by tile in .asc notation, as\n");
+	log("        'B<bit_y>[<bit_x>] <value_a> <value_b>' below the tile header.\n");
+	log("        the exit status is 1 if the configs differ.\n");
+	log("\n");
+	log("    -e <edit_file>\n");
+	log("        patch mode: apply the bit changes in the edit file directly to\n");
+	log("        the input bitstream and update its CRC checks. the edit file\n");
+	log("        has .asc tile headers followed by 'B<bit_y>[<bit_x>] <value>'\n");
+	log("        lines or .ram_data rows. the bit lines of the -D output work too.\n");
+	log("\n");
+	log("    -j <num_threads>\n");
+	log("        use up to the given number of threads for writing the ascii file.\n");
+	log("        in batch mode the jobs run in parallel, and threads left over\n");
+	log("        when there are fewer jobs are used for writing ascii files\n");
+	log("\n");
+	log("    -M <job_file>\n");
+	log("        batch mode: run all conversions listed in the job file, one\n");
+	log("        '[-u] [-C] [-z] input-file output-file' per line, and print a\n");
+	log("        summary. -u, -C and -z on the command line apply to all jobs.\n");
+	log("        cannot be combined with -D, -e or the netpbm options\n");
+	log("\n");
 	exit(1);
 }
 
@@ -1104,25 +519,39 @@ int main(int argc, char **argv)
 {
 	vector<string> parameters;
 	bool unpack_mode = false;
+	bool binary_output = false;
+	bool skip_zero_rows = false;
+	bool diff_mode = false;
 	bool netpbm_mode = false;
 	bool netpbm_bram = false;
 	bool netpbm_fill_tiles = false;
 	bool netpbm_checkerboard = false;
 	int netpbm_banknum = -1;
+	bool netpbm_binary = false;
 	int checkerboard_m = 1;
+	int num_threads = 1;
+	string batch_file;
+	string edit_file;
+	StatsReport stats_report;
 
 	for (int i = 0; argv[0][i]; i++)
 		if (string(argv[0]+i) == "iceunpack")
 			unpack_mode = true;
 
-	for (int i = 1; i < argc; i++)
+	for (int idx = 1; idx < argc; idx++)
 	{
-		string arg(argv[i]);
+		string arg(argv[idx]);
 
 		if (arg[0] == '-' && arg.size() > 1) {
 			for (int i = 1; i < int(arg.size()); i++)
 				if (arg[i] == 'u') {
 					unpack_mode = true;
+				} else if (arg[i] == 'D') {
+					diff_mode = true;
+				} else if (arg[i] == 'C') {
+					binary_output = true;
+				} else if (arg[i] == 'z') {
+					skip_zero_rows = true;
 				} else if (arg[i] == 'b') {
 					netpbm_mode = true;
 				} else if (arg[i] == 'r') {
@@ -1138,8 +567,47 @@ int main(int argc, char **argv)
 				} else if (arg[i] == 'B') {
 					netpbm_mode = true;
 					netpbm_banknum = arg[++i] - '0';
+				} else if (arg[i] == 'p') {
+					netpbm_mode = true;
+					netpbm_binary = true;
 				} else if (arg[i] == 'v') {
 					log_level++;
+				} else if (arg[i] == 'T') {
+					stats_report.summary = true;
+				} else if (arg[i] == 'J') {
+					if (arg[i+1])
+						stats_report.json_file = arg.substr(i+1);
+					else if (idx+1 < argc)
+						stats_report.json_file = argv[++idx];
+					else
+						usage();
+					break;
+				} else if (arg[i] == 'j') {
+					if (arg[i+1])
+						num_threads = atoi(arg.c_str()+i+1);
+					else if (idx+1 < argc)
+						num_threads = atoi(argv[++idx]);
+					else
+						usage();
+					if (num_threads < 1)
+						usage();
+					break;
+				} else if (arg[i] == 'e') {
+					if (arg[i+1])
+						edit_file = arg.substr(i+1);
+					else if (idx+1 < argc)
+						edit_file = argv[++idx];
+					else
+						usage();
+					break;
+				} else if (arg[i] == 'M') {
+					if (arg[i+1])
+						batch_file = arg.substr(i+1);
+					else if (idx+1 < argc)
+						batch_file = argv[++idx];
+					else
+						usage();
+					break;
 				} else
 					usage();
 			continue;
@@ -1148,45 +616,66 @@ int main(int argc, char **argv)
 		parameters.push_back(arg);
 	}
 
-	std::ifstream ifs;
-	std::ofstream ofs;
-
-	std::istream *isp;
-	std::ostream *osp;
+	stats_enabled = stats_report.summary || !stats_report.json_file.empty();
 
-	if (parameters.size() >= 1 && parameters[0] != "-") {
-		ifs.open(parameters[0], std::ios::binary);
-		if (!ifs.is_open())
-			error("Failed to open input file.\n");
-		isp = &ifs;
-	} else {
-		isp = &std::cin;
+	if (!batch_file.empty()) {
+		if (netpbm_mode || diff_mode || !edit_file.empty() || !parameters.empty())
+			usage();
+		vector<BatchJob> jobs;
+		read_batch_file(batch_file, unpack_mode, binary_output, skip_zero_rows, jobs);
+		return run_batch(jobs, num_threads);
 	}
 
-	if (parameters.size() >= 2 && parameters[1] != "-") {
-		ofs.open(parameters[1], std::ios::binary);
-		if (!ofs.is_open())
-			error("Failed to open output file.\n");
-		osp = &ofs;
-	} else {
-		osp = &std::cout;
+	if (diff_mode) {
+		if (netpbm_mode || !edit_file.empty() || parameters.size() != 2)
+			usage();
+		FpgaConfig configs[2];
+		for (int i = 0; i < 2; i++)
+			read_input_file(configs[i], parameters[i], true);
+		int num_diffs = configs[0].write_diff(std::cout, configs[1]);
+		info("%d differences.\n", num_diffs);
+		return num_diffs ? 1 : 0;
 	}
 
 	if (parameters.size() > 2)
 		usage();
 
-	FpgaConfig fpga_config;
+	// the output file is only created once the input has been read
+	string input_file = parameters.size() >= 1 ? parameters[0] : "-";
+	string output_file = parameters.size() >= 2 ? parameters[1] : "-";
 
-	if (unpack_mode) {
-		fpga_config.read_bits(*isp);
-		if (!netpbm_mode)
-			fpga_config.write_ascii(*osp);
-	} else {
-		fpga_config.read_ascii(*isp);
-		if (!netpbm_mode)
-			fpga_config.write_bits(*osp);
+	std::ofstream ofs;
+	auto open_output = [&]() -> std::ostream& {
+		if (output_file == "-")
+			return std::cout;
+		ofs.open(output_file, std::ios::binary);
+		if (!ofs.is_open())
+			error("Failed to open output file.\n");
+		return ofs;
+	};
+
+	if (!edit_file.empty()) {
+		if (netpbm_mode || binary_output || unpack_mode || skip_zero_rows)
+			usage();
+		vector<BitEdit> edits;
+		read_edit_file(edit_file, edits);
+		vector<uint8_t> data;
+		read_input_data(input_file, data);
+		patch_bitstream(data, edits);
+		open_output().write(reinterpret_cast<const char*>(data.data()), data.size());
+		info("Done.\n");
+		return 0;
 	}
 
+	FpgaConfig fpga_config;
+
+	read_input_file(fpga_config, input_file, unpack_mode);
+
+	std::ostream &os = open_output();
+
+	if (!netpbm_mode)
+		write_output(fpga_config, os, unpack_mode, binary_output, num_threads, skip_zero_rows);
+
 	if (netpbm_checkerboard) {
 		fpga_config.cram_clear();
 		fpga_config.cram_checkerboard(checkerboard_m);
@@ -1197,9 +686,14 @@ int main(int argc, char **argv)
 
 	if (netpbm_mode) {
 		if (netpbm_bram)
-			fpga_config.write_bram_pbm(*osp, netpbm_banknum);
+			fpga_config.write_bram_pbm(os, netpbm_banknum, netpbm_binary);
 		else
-			fpga_config.write_cram_pbm(*osp, netpbm_banknum);
+			fpga_config.write_cram_pbm(os, netpbm_banknum, netpbm_binary);
+	}
+
+	{
+		ScopedTimer timer(TIMER_WRITE_OUTPUT);
+		os.flush();
 	}
 
 	info("Done.\n");
@@ -0,0 +1,342 @@
+//
+//  Copyright (C) 2015  Clifford Wolf <clifford@clifford.at>
+//
+//  Based on a reference implementation provided by Mathias Lasser
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted, provided that the above
+//  copyright notice and this permission notice appear in all copies.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+//  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+//  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+//  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+//  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+//  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+//  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+// C++ interface of libicepack: iCE40 bitstream (.bin) and icebox (.asc)
+// reading and writing and access to the individual configuration bits.
+// See libicepack.h for the C interface.
+
+#ifndef ICEPACK_H
+#define ICEPACK_H
+
+#include <vector>
+#include <string>
+#include <iostream>
+#include <cstdint>
+#include <cstddef>
+
+// Errors (malformed input files, unknown devices, ..) print a message to
+// stderr and exit the process. When errors_throw is set for the calling
+// thread an ErrorException with the message is thrown instead and nothing
+// is printed.
+extern thread_local bool errors_throw;
+
+struct ErrorException
+{
+	std::string message;
+};
+
+// One CRAM or BRAM bank as a packed bit array. Bits are stored in the order
+// they are streamed in the bitstream: row-major (all of row 0, then row 1,
+// ..), MSB first within each byte. Rows are not padded, so a whole bank or
+// any run of rows can be copied to/from a bitstream payload as bytes. The
+// buffer is zero-padded to a multiple of 8 bytes for word-wise operations.
+struct BitPlane
+{
+	int width = 0, height = 0;
+	std::vector<uint8_t> data;
+
+	void resize(int width, int height);
+	void clear();
+
+	int num_bits() const { return width * height; }
+
+	bool get(int x, int y) const {
+		int i = y * width + x;
+		return (data[i >> 3] & (0x80 >> (i & 7))) != 0;
+	}
+
+	void set(int x, int y, bool value = true) {
+		int i = y * width + x;
+		if (value)
+			data[i >> 3] |= 0x80 >> (i & 7);
+		else
+			data[i >> 3] &= ~(0x80 >> (i & 7));
+	}
+
+	// copy num_rows full rows starting at row y from/to a packed buffer
+	void load_rows(int y, int num_rows, const uint8_t *src);
+	void store_rows(int y, int num_rows, uint8_t *dst) const;
+};
+
+// position of a bit in a CRAM or BRAM bank
+struct BankIndex
+{
+	uint8_t bank;
+	uint16_t x, y;
+};
+
+enum TileType
+{
+	TILE_CORNER,
+	TILE_IO,
+	TILE_LOGIC,
+	TILE_RAMB,
+	TILE_RAMT
+};
+
+// Tile layout and bank sizes of a device type. There is one static instance
+// per device, so the queries below do not allocate and need no string compares.
+struct DeviceGeometry
+{
+	std::string name;
+	int chip_width, chip_height;
+	int cram_width, cram_height;
+	int bram_width, bram_height;
+
+	// cram column widths of one bank, from the io column towards the center
+	// of the chip, and their prefix sums (col_offset[i] = sum of cols[0..i-1])
+	std::vector<int> cols;
+	std::vector<int> col_offset;
+
+	// x coordinates of the ram tile columns
+	std::vector<int> ram_cols;
+
+	// tile_types[Y*(chip_width+2) + X]
+	std::vector<TileType> tile_types;
+
+	DeviceGeometry(const std::string &name, int chip_width, int chip_height, int cram_width, int cram_height,
+			int bram_width, int bram_height, const std::vector<int> &cols, const std::vector<int> &ram_cols);
+
+	TileType tile_type(int x, int y) const {
+		return tile_types[y*(chip_width+2) + x];
+	}
+
+	// nullptr for unknown devices
+	static const DeviceGeometry *find(const std::string &device);
+
+	static const char *tile_type_name(TileType type);
+	static int tile_width(TileType type);
+};
+
+struct FpgaConfig
+{
+	std::string device;
+	std::string freqrange;
+	std::string warmboot;
+
+	// cram[BANK].get(X, Y)
+	int cram_width, cram_height;
+	std::vector<BitPlane> cram;
+
+	// bram[BANK].get(X, Y)
+	int bram_width, bram_height;
+	std::vector<BitPlane> bram;
+
+	// data before preamble
+	std::vector<uint8_t> initblop;
+
+	// bitstream i/o
+	void read_bits(std::istream &ifs);
+	void read_bits(const uint8_t *data, size_t len);
+	// with skip_zero_rows the all-zero rows of the banks are left out
+	void write_bits(std::ostream &ofs, bool skip_zero_rows = false) const;
+	void write_bits(std::vector<uint8_t> &data, bool skip_zero_rows = false) const;
+
+	// icebox i/o
+	void read_ascii(std::istream &ifs);
+	void read_ascii(const char *text, size_t text_len);
+	void write_ascii(std::ostream &ofs, int num_threads = 1) const;
+
+	// compact binary i/o (see fpgaconfig.cc for the file format)
+	static bool is_binary(const void *data, size_t len);
+	static bool is_binary(std::istream &ifs);
+	void read_binary(std::istream &ifs);
+	void read_binary(const uint8_t *data, size_t len);
+	void write_binary(std::ostream &ofs) const;
+	void write_binary(std::vector<uint8_t> &data) const;
+
+	// write the differences to another config of the same device, tile by
+	// tile in .asc notation, and return the number of differences
+	int write_diff(std::ostream &ofs, const FpgaConfig &other) const;
+
+	// netpbm i/o, ascii (P1) or binary (P4)
+	void write_cram_pbm(std::ostream &ofs, int bank_num = -1, bool binary = false) const;
+	void write_bram_pbm(std::ostream &ofs, int bank_num = -1, bool binary = false) const;
+
+	// query chip type metadata
+	const DeviceGeometry &geometry() const;
+	int chip_width() const;
+	int chip_height() const;
+	const std::vector<int> &chip_cols() const;
+
+	// query tile metadata
+	std::string tile_type(int x, int y) const;
+	int tile_width(const std::string &type) const;
+
+	// set cram bits outside of all tiles, sorted by bank, x and y
+	void get_extra_bits(std::vector<BankIndex> &extra_bits) const;
+
+	// cram bit manipulation
+	void cram_clear();
+	void cram_fill_tiles();
+	void cram_checkerboard(int m = 0);
+};
+
+// Incremental bitstream parser for data that arrives in pieces, e.g. from a
+// pipe or a socket. push() takes chunks of any size and calls the on_*()
+// handlers as soon as the corresponding part of the bitstream is complete,
+// bank data in runs of whole rows. At most one data block of a few kB is
+// buffered. Errors, including CRC check failures, are reported with error().
+// FpgaConfig::read_bits() is implemented on top of this.
+struct BitstreamDecoder
+{
+	enum State { PREAMBLE, COMMAND, PAYLOAD, BANK_DATA, END_TOKEN, DONE };
+
+	State state = PREAMBLE;
+	int file_offset = 0;
+	uint16_t crc_value = 0;
+
+	// detected from the width of the first CRAM bank, empty until then
+	std::string device;
+
+	// data before preamble
+	std::vector<uint8_t> initblop;
+	uint32_t preamble = 0;
+
+	// command that is being parsed
+	uint8_t command = 0;
+	uint32_t payload = 0;
+	int payload_bytes = 0;
+
+	// bank settings (commands 0x10 and 0x60 .. 0x80)
+	int current_bank = 0;
+	int current_width = 0;
+	int current_height = 0;
+	int current_offset = 0;
+
+	// bank data: bram or cram, bytes still expected, rows already passed on,
+	// and the beginning of the bank data not passed on yet (row_bits bits)
+	bool data_bram = false;
+	int data_bytes_left = 0;
+	int data_rows_done = 0;
+	int row_bits = 0;
+	std::vector<uint8_t> row_buffer;
+
+	// only check the CRC of bank data, do not call on_bank_rows()
+	bool skip_bank_data = false;
+
+	virtual ~BitstreamDecoder() { }
+
+	// feed the next len bytes of the bitstream. data after the wakeup command is ignored.
+	void push(const uint8_t *data, size_t len);
+
+	// true once the wakeup command has been seen
+	bool done() const { return state == DONE; }
+
+	// handlers, the default implementations do nothing
+	virtual void on_preamble() { }
+	virtual void on_device() { }
+	virtual void on_bank_begin(bool bram, int bank, int width, int height, int offset) { }
+	virtual void on_bank_rows(bool bram, int bank, int y, int num_rows, int width, const uint8_t *rows) { }
+	virtual void on_crc_reset() { }
+	virtual void on_crc_check() { }
+	virtual void on_freqrange(const std::string &freqrange) { }
+	virtual void on_warmboot(const std::string &warmboot) { }
+	virtual void on_wakeup() { }
+
+	void execute_command();
+	void push_bank_data(const uint8_t *data, int len);
+	void flush_rows(bool last);
+};
+
+// A change of one config bit for patch_bitstream(): bit B<bit_y>[<bit_x>] of
+// a tile, bit <bit_x> of row <bit_y> of the .ram_data of a ramb tile, or
+// bit (bit_x, bit_y) of a CRAM or BRAM bank (like .extra_bit in .asc files).
+struct BitEdit
+{
+	enum Kind { TILE_BIT, RAM_DATA_BIT, CRAM_BIT, BRAM_BIT };
+
+	Kind kind;
+	int tile_x, tile_y;
+	int bank;
+	int bit_x, bit_y;
+	bool value;
+};
+
+// Apply the edits directly to the bank data in a bitstream and update the
+// CRC check values that follow changed bytes. The rest of the bitstream is
+// only scanned for the positions of the bank data and CRC checks.
+void patch_bitstream(std::vector<uint8_t> &data, const std::vector<BitEdit> &edits);
+
+// Lookup tables mapping tile bits to bank bits for one device type. They
+// are built on first use and shared by all FpgaConfig objects for the device.
+struct DeviceTables
+{
+	int chip_width, chip_height;
+
+	// cram_index[cram_offset[Y*(chip_width+2) + X] + BIT_Y*TILE_WIDTH + BIT_X]
+	std::vector<int> cram_offset;
+	std::vector<BankIndex> cram_index;
+
+	// bram_index[BIT_Y*256 + BIT_X], relative to the bank offset of the tile
+	std::vector<BankIndex> bram_index;
+
+	// cram_covered[BANK] has all CRAM bits set that belong to a tile
+	std::vector<BitPlane> cram_covered;
+
+	// cram_row_dir[Y*(chip_width+2) + X] is 1 (or -1) if each row of the tile
+	// is a run of bits with increasing (decreasing) x in one bank row, else 0
+	std::vector<int8_t> cram_row_dir;
+
+	DeviceTables(const DeviceGeometry &geom);
+	static const DeviceTables &get(const FpgaConfig *fpga);
+};
+
+struct CramIndexConverter
+{
+	const FpgaConfig *fpga;
+	int tile_x, tile_y;
+
+	TileType tile_type;
+	const char *tile_name;
+	int tile_width;
+
+	// index[BIT_Y*tile_width + BIT_X]
+	const BankIndex *index;
+
+	// see DeviceTables::cram_row_dir
+	int row_dir;
+
+	CramIndexConverter(const FpgaConfig *fpga, int tile_x, int tile_y);
+
+	void get_cram_index(int bit_x, int bit_y, int &cram_bank, int &cram_x, int &cram_y) const {
+		const BankIndex &idx = index[bit_y*tile_width + bit_x];
+		cram_bank = idx.bank, cram_x = idx.x, cram_y = idx.y;
+	}
+};
+
+struct BramIndexConverter
+{
+	const FpgaConfig *fpga;
+	int tile_x, tile_y;
+
+	int bank_num;
+	int bank_off;
+
+	// index[BIT_Y*256 + BIT_X]
+	const BankIndex *index;
+
+	BramIndexConverter(const FpgaConfig *fpga, int tile_x, int tile_y);
+
+	void get_bram_index(int bit_x, int bit_y, int &bram_bank, int &bram_x, int &bram_y) const {
+		const BankIndex &idx = index[bit_y*256 + bit_x];
+		bram_bank = bank_num, bram_x = bank_off + idx.x, bram_y = idx.y;
+	}
+};
+
+#endif
@@ -0,0 +1,653 @@
+//
+//  Copyright (C) 2015  Clifford Wolf <clifford@clifford.at>
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted, provided that the above
+//  copyright notice and this permission notice appear in all copies.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+//  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+//  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+//  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+//  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+//  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+//  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+// Throughput benchmark and round-trip check for the FpgaConfig readers and
+// writers
+//
+// Usage: icepack_bench [-r runs] [-o results.json]
+//        icepack_bench -g <device> <fill> <output.bin>
+//        icepack_bench -R <num_configs> [-s seed] [-o results.json]
+//        icepack_bench -k <iterations> [-r runs]
+//
+// For each device type and fill pattern a synthetic config is generated
+// and read_bits, write_bits, read_ascii and write_ascii are timed
+// separately (best of 'runs', default 5). The fill patterns are:
+//
+//   random   every CRAM bit and every BRAM bit of the ram tiles is set
+//            with probability 1/2
+//   sparse   about 4% of the tile config bits set, no bits outside of the
+//            tiles, and every other ram tile with random contents, which
+//            is closer to real designs
+//
+// The results are printed as a table and written as JSON with -o. MB/s is
+// relative to the size of the file read or written, ns/bit relative to the
+// number of CRAM and BRAM bits of the device.
+//
+// With -g only the synthetic bitstream is written to the given file.
+//
+// With -R random configs for all device types (random or sparse fill, random
+// extra bits, comment lines, freqrange and warmboot) are passed through every
+// reader/writer pair (bitstreams with and without skip_zero_rows) and compared
+// bit for bit, and the optimized paths are cross-checked against their
+// reference versions: multi-threaded against single-threaded write_ascii, the
+// specialized against the generic tile kernel, crc16() against
+// crc16_bitwise(), and patch_bitstream() against write_bits() of the edited
+// config. The time spent in each path is reported like the benchmark results.
+// The exit status is 1 if any check fails.
+//
+// With -k the per-tile kernels in tilekernels.h are benchmarked: all tiles of
+// a random config for each device type are rendered 'iterations' times with
+// the generic and the specialized kernel, and the results are compared.
+
+#include <vector>
+#include <string>
+#include <sstream>
+#include <chrono>
+#include <fstream>
+#include <functional>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "icepack.h"
+#include "tilekernels.h"
+#include "crc16.h"
+
+using std::vector;
+using std::string;
+
+static const char *devices[] = { "384", "1k", "8k" };
+static const char *fills[] = { "random", "sparse" };
+
+static uint32_t rng_state = 1;
+
+static uint32_t rng()
+{
+	rng_state = rng_state * 1103515245 + 12345;
+	return rng_state >> 8;
+}
+
+// Fill the banks of a config. BRAM bits are only set through the ram tiles,
+// since .asc files cannot represent other BRAM bits.
+static void fill_config(FpgaConfig &fpga, const string &fill)
+{
+	bool random = fill == "random";
+
+	if (!random && fill != "sparse") {
+		fprintf(stderr, "Unknown fill pattern '%s'.\n", fill.c_str());
+		exit(1);
+	}
+
+	if (random)
+		for (auto &plane : fpga.cram)
+			for (int i = 0; i < plane.num_bits(); i++)
+				plane.set(i % plane.width, i / plane.width, rng() & 1);
+
+	for (int y = 0; y <= fpga.chip_height()+1; y++)
+	for (int x = 0; x <= fpga.chip_width()+1; x++)
+	{
+		CramIndexConverter cic(&fpga, x, y);
+		for (int bit_y = 0; bit_y < 16 && !random; bit_y++)
+		for (int bit_x = 0; bit_x < cic.tile_width; bit_x++) {
+			if (rng() % 25 != 0)
+				continue;
+			int bank, bank_x, bank_y;
+			cic.get_cram_index(bit_x, bit_y, bank, bank_x, bank_y);
+			fpga.cram[bank].set(bank_x, bank_y);
+		}
+
+		if (cic.tile_type != TILE_RAMB || (!random && (x + y / 2) % 2 != 0))
+			continue;
+
+		BramIndexConverter bic(&fpga, x, y);
+		for (int bit_y = 0; bit_y < 16; bit_y++)
+		for (int bit_x = 0; bit_x < 256; bit_x++) {
+			int bank, bank_x, bank_y;
+			bic.get_bram_index(bit_x, bit_y, bank, bank_x, bank_y);
+			if (bank_x < fpga.bram_width && bank_y < fpga.bram_height)
+				fpga.bram[bank].set(bank_x, bank_y, rng() & 1);
+		}
+	}
+}
+
+static void generate(FpgaConfig &fpga, const string &device, const string &fill)
+{
+	string asc = ".comment\nsynthetic " + fill + " config\n.device " + device + "\n";
+	fpga.read_ascii(asc.data(), asc.size());
+	fill_config(fpga, fill);
+}
+
+// all tiles of the chip, returns the size of their rendered text
+static size_t get_tiles(const FpgaConfig &fpga, vector<CramIndexConverter> &tiles)
+{
+	size_t tile_chars = 0;
+	for (int y = 0; y <= fpga.chip_height()+1; y++)
+	for (int x = 0; x <= fpga.chip_width()+1; x++) {
+		tiles.push_back(CramIndexConverter(&fpga, x, y));
+		tile_chars += 16 * (tiles.back().tile_width + 1);
+	}
+	return tile_chars;
+}
+
+typedef void (*render_func_t)(const FpgaConfig *fpga, const CramIndexConverter &cic, char *out);
+
+static void render_tiles(const FpgaConfig &fpga, render_func_t func, const vector<CramIndexConverter> &tiles, string &out)
+{
+	char *p = &out[0];
+	for (auto &cic : tiles) {
+		func(&fpga, cic, p);
+		p += 16 * (cic.tile_width + 1);
+	}
+}
+
+// ostream that only counts the bytes written to it
+struct CountingBuffer : std::streambuf
+{
+	size_t count = 0;
+
+	int overflow(int ch) override {
+		count++;
+		return ch;
+	}
+
+	std::streamsize xsputn(const char *s, std::streamsize n) override {
+		count += n;
+		return n;
+	}
+};
+
+struct Result
+{
+	string device, fill, operation;
+	size_t bytes;
+	double seconds, ns_per_bit, mb_per_s;
+};
+
+static double best_time(int runs, const std::function<void()> &func)
+{
+	double best_seconds = 0;
+	for (int run = 0; run < runs; run++) {
+		auto t0 = std::chrono::steady_clock::now();
+		func();
+		auto t1 = std::chrono::steady_clock::now();
+		double seconds = std::chrono::duration<double>(t1 - t0).count();
+		if (run == 0 || seconds < best_seconds)
+			best_seconds = seconds;
+	}
+	return best_seconds;
+}
+
+// ==================================================================
+// Round-trip check
+
+static const BitPlane *get_plane(const vector<BitPlane> &planes, int bank)
+{
+	static const BitPlane empty;
+	return bank < int(planes.size()) ? &planes[bank] : &empty;
+}
+
+static bool configs_equal(const FpgaConfig &a, const FpgaConfig &b, string &why)
+{
+	if (a.device != b.device || a.freqrange != b.freqrange || a.warmboot != b.warmboot) {
+		why = "device, freqrange or warmboot differ";
+		return false;
+	}
+
+	if (a.initblop != b.initblop) {
+		why = "comments differ";
+		return false;
+	}
+
+	for (int bram = 0; bram < 2; bram++)
+	for (int bank = 0; bank < 4; bank++) {
+		const BitPlane *pa = get_plane(bram ? a.bram : a.cram, bank);
+		const BitPlane *pb = get_plane(bram ? b.bram : b.cram, bank);
+		if (pa->width != pb->width || pa->height != pb->height || pa->data != pb->data) {
+			why = string(bram ? "BRAM" : "CRAM") + " bank " + std::to_string(bank) + " differs";
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// random config with comments, freqrange, warmboot and extra bits
+static void generate_variant(FpgaConfig &fpga, const string &device)
+{
+	static const char *freqranges[] = { "low", "medium", "high" };
+	static const char *warmboots[] = { "enabled", "disabled" };
+
+	string asc = ".comment\n";
+	for (int i = rng() % 4; i > 0; i--) {
+		// no empty lines and no leading '.', those do not survive .asc files
+		asc += 'a' + rng() % 26;
+		for (int k = rng() % 40; k > 0; k--)
+			asc += char(' ' + rng() % 95);
+		asc += '\n';
+	}
+	asc += ".device " + device + "\n";
+	fpga.read_ascii(asc.data(), asc.size());
+
+	fpga.freqrange = freqranges[rng() % 3];
+	fpga.warmboot = warmboots[rng() % 2];
+
+	fill_config(fpga, fills[rng() % 2]);
+
+	const DeviceTables &tables = DeviceTables::get(&fpga);
+	for (int i = rng() % 64; i > 0; i--) {
+		int bank = rng() % 4, x = rng() % fpga.cram_width, y = rng() % fpga.cram_height;
+		if (!tables.cram_covered[bank].get(x, y))
+			fpga.cram[bank].set(x, y);
+	}
+}
+
+// random changes to a config, applied to 'edited' and recorded as edits
+static void generate_edits(FpgaConfig &edited, vector<BitEdit> &edits)
+{
+	for (int i = rng() % 100; i > 0; i--)
+	{
+		int tile_x = rng() % (edited.chip_width() + 2), tile_y = rng() % (edited.chip_height() + 2);
+		CramIndexConverter cic(&edited, tile_x, tile_y);
+		int kind = rng() % 3;
+
+		if (kind == 0 && cic.tile_width > 0) {
+			BitEdit edit = { BitEdit::TILE_BIT, tile_x, tile_y, 0, int(rng() % cic.tile_width), int(rng() % 16), (rng() & 1) != 0 };
+			int bank, x, y;
+			cic.get_cram_index(edit.bit_x, edit.bit_y, bank, x, y);
+			edited.cram[bank].set(x, y, edit.value);
+			edits.push_back(edit);
+		}
+
+		if (kind == 1 && cic.tile_type == TILE_RAMB) {
+			BitEdit edit = { BitEdit::RAM_DATA_BIT, tile_x, tile_y, 0, int(rng() % 256), int(rng() % 16), (rng() & 1) != 0 };
+			BramIndexConverter bic(&edited, tile_x, tile_y);
+			int bank, x, y;
+			bic.get_bram_index(edit.bit_x, edit.bit_y, bank, x, y);
+			if (x < edited.bram_width && y < edited.bram_height) {
+				edited.bram[bank].set(x, y, edit.value);
+				edits.push_back(edit);
+			}
+		}
+
+		if (kind == 2) {
+			BitEdit edit = { BitEdit::CRAM_BIT, 0, 0, int(rng() % 4), int(rng() % edited.cram_width),
+					int(rng() % edited.cram_height), (rng() & 1) != 0 };
+			edited.cram[edit.bank].set(edit.bit_x, edit.bit_y, edit.value);
+			edits.push_back(edit);
+		}
+	}
+}
+
+struct PathStats
+{
+	string path;
+	int checks, failures;
+	double seconds;
+};
+
+static int run_roundtrip(int num_configs, uint32_t seed, const string &json_file)
+{
+	vector<PathStats> stats;
+	int num_failures = 0;
+
+	// time func as 'path'. check is evaluated afterwards, outside of the timer.
+	auto run_path = [&](const string &device, int index, const char *path,
+			const std::function<void()> &func, const std::function<bool(string&)> &check)
+	{
+		auto t0 = std::chrono::steady_clock::now();
+		func();
+		auto t1 = std::chrono::steady_clock::now();
+
+		int i = 0;
+		while (i < int(stats.size()) && stats[i].path != path)
+			i++;
+		if (i == int(stats.size()))
+			stats.push_back(PathStats{path, 0, 0, 0});
+
+		string why;
+		bool ok = check(why);
+
+		stats[i].checks++;
+		stats[i].failures += !ok;
+		stats[i].seconds += std::chrono::duration<double>(t1 - t0).count();
+
+		if (!ok) {
+			printf("FAIL: config %d (%s, seed %u): %s: %s\n", index, device.c_str(), seed, path, why.c_str());
+			num_failures++;
+		}
+	};
+
+	rng_state = seed;
+
+	for (int index = 0; index < num_configs; index++)
+	{
+		string device = devices[index % (sizeof(devices) / sizeof(*devices))];
+
+		FpgaConfig fpga;
+		generate_variant(fpga, device);
+
+		vector<uint8_t> bits;
+		run_path(device, index, "write_bits", [&]() {
+			fpga.write_bits(bits);
+		}, [&](string &why) {
+			why = "empty bitstream";
+			return !bits.empty();
+		});
+
+		FpgaConfig from_bits;
+		run_path(device, index, "read_bits", [&]() {
+			from_bits.read_bits(bits.data(), bits.size());
+		}, [&](string &why) {
+			return configs_equal(fpga, from_bits, why);
+		});
+
+		FpgaConfig from_bits_stream;
+		run_path(device, index, "read_bits_stream", [&]() {
+			std::istringstream is(string(bits.begin(), bits.end()));
+			from_bits_stream.read_bits(is);
+		}, [&](string &why) {
+			return configs_equal(fpga, from_bits_stream, why);
+		});
+
+		vector<uint8_t> bits_nonzero;
+		run_path(device, index, "write_bits_nonzero", [&]() {
+			fpga.write_bits(bits_nonzero, true);
+		}, [&](string &why) {
+			FpgaConfig from_bits_nonzero;
+			from_bits_nonzero.read_bits(bits_nonzero.data(), bits_nonzero.size());
+			return configs_equal(fpga, from_bits_nonzero, why);
+		});
+
+		string asc;
+		run_path(device, index, "write_ascii", [&]() {
+			std::ostringstream os;
+			fpga.write_ascii(os);
+			asc = os.str();
+		}, [&](string &why) {
+			why = "empty .asc file";
+			return !asc.empty();
+		});
+
+		string asc_mt;
+		run_path(device, index, "write_ascii_mt", [&]() {
+			std::ostringstream os;
+			fpga.write_ascii(os, 4);
+			asc_mt = os.str();
+		}, [&](string &why) {
+			why = "differs from single-threaded output";
+			return asc_mt == asc;
+		});
+
+		// .asc files do not store freqrange and warmboot
+		FpgaConfig fpga_asc = fpga;
+		fpga_asc.freqrange = "low";
+		fpga_asc.warmboot = "enabled";
+
+		vector<uint8_t> bits_asc;
+		fpga_asc.write_bits(bits_asc);
+
+		FpgaConfig from_asc;
+		run_path(device, index, "read_ascii", [&]() {
+			from_asc.read_ascii(asc.data(), asc.size());
+		}, [&](string &why) {
+			return configs_equal(fpga_asc, from_asc, why);
+		});
+
+		vector<uint8_t> bits_from_asc;
+		run_path(device, index, "bin_asc_bin", [&]() {
+			from_asc.write_bits(bits_from_asc);
+		}, [&](string &why) {
+			why = "bitstream differs";
+			return bits_from_asc == bits_asc;
+		});
+
+		vector<uint8_t> binary;
+		run_path(device, index, "write_binary", [&]() {
+			fpga.write_binary(binary);
+		}, [&](string &why) {
+			why = "not detected as binary config";
+			return FpgaConfig::is_binary(binary.data(), binary.size());
+		});
+
+		FpgaConfig from_binary;
+		run_path(device, index, "read_binary", [&]() {
+			from_binary.read_binary(binary.data(), binary.size());
+		}, [&](string &why) {
+			return configs_equal(fpga, from_binary, why);
+		});
+
+		uint16_t crc = 0, crc_reference = 0;
+		run_path(device, index, "crc16", [&]() {
+			crc = crc16(0xffff, bits.data(), bits.size());
+		}, [&](string&) {
+			return true;
+		});
+		run_path(device, index, "crc16_bitwise", [&]() {
+			crc_reference = crc16_bitwise(0xffff, bits.data(), bits.size());
+		}, [&](string &why) {
+			why = "differs from crc16()";
+			return crc == crc_reference;
+		});
+
+		vector<CramIndexConverter> tiles;
+		size_t tile_chars = get_tiles(fpga, tiles);
+
+		string tile_text(tile_chars, 0), tile_text_reference(tile_chars, 0);
+		run_path(device, index, "render_tile_bits", [&]() {
+			render_tiles(fpga, render_tile_bits, tiles, tile_text);
+		}, [&](string&) {
+			return true;
+		});
+		run_path(device, index, "render_tile_bits_generic", [&]() {
+			render_tiles(fpga, render_tile_bits_generic, tiles, tile_text_reference);
+		}, [&](string &why) {
+			why = "differs from render_tile_bits()";
+			return tile_text == tile_text_reference;
+		});
+
+		FpgaConfig edited = fpga;
+		vector<BitEdit> edits;
+		generate_edits(edited, edits);
+
+		vector<uint8_t> patched = bits, edited_bits;
+		edited.write_bits(edited_bits);
+		run_path(device, index, "patch_bitstream", [&]() {
+			patch_bitstream(patched, edits);
+		}, [&](string &why) {
+			why = "differs from write_bits() of the edited config";
+			return patched == edited_bits;
+		});
+	}
+
+	printf("%-26s %8s %8s %12s\n", "path", "checks", "failed", "ms");
+	for (auto &it : stats)
+		printf("%-26s %8d %8d %12.3f\n", it.path.c_str(), it.checks, it.failures, 1e3 * it.seconds);
+	printf("\n%d configs, %d failures.\n", num_configs, num_failures);
+
+	if (!json_file.empty())
+	{
+		FILE *f = fopen(json_file.c_str(), "w");
+		if (f == nullptr) {
+			fprintf(stderr, "Failed to open output file '%s'.\n", json_file.c_str());
+			return 1;
+		}
+
+		fprintf(f, "{\n  \"seed\": %u,\n  \"configs\": %d,\n  \"failures\": %d,\n  \"paths\": [", seed, num_configs, num_failures);
+		for (int i = 0; i < int(stats.size()); i++)
+			fprintf(f, "%s\n    { \"path\": \"%s\", \"checks\": %d, \"failures\": %d, \"seconds\": %.9f }", i ? "," : "",
+					stats[i].path.c_str(), stats[i].checks, stats[i].failures, stats[i].seconds);
+		fprintf(f, "\n  ]\n}\n");
+		fclose(f);
+	}
+
+	return num_failures ? 1 : 0;
+}
+
+// ==================================================================
+// Tile kernel benchmark
+
+static int run_tile_kernels(int iterations, int runs)
+{
+	for (const char *device : devices)
+	{
+		FpgaConfig fpga;
+		generate(fpga, device, "random");
+
+		vector<CramIndexConverter> tiles;
+		size_t tile_chars = get_tiles(fpga, tiles);
+
+		string generic_out(tile_chars, 0), out(tile_chars, 0);
+		double generic_seconds = best_time(runs, [&]() {
+			for (int i = 0; i < iterations; i++)
+				render_tiles(fpga, render_tile_bits_generic, tiles, generic_out);
+		});
+		double seconds = best_time(runs, [&]() {
+			for (int i = 0; i < iterations; i++)
+				render_tiles(fpga, render_tile_bits, tiles, out);
+		});
+
+		if (out != generic_out) {
+			printf("%-5s  MISMATCH\n", device);
+			return 1;
+		}
+
+		double bits = double(tile_chars) * iterations;
+		printf("%-5s  generic %8.3f ns/bit  specialized %8.3f ns/bit  speedup %.2fx\n", device,
+				generic_seconds * 1e9 / bits, seconds * 1e9 / bits, generic_seconds / seconds);
+	}
+
+	return 0;
+}
+
+// ==================================================================
+// Main program
+
+int main(int argc, char **argv)
+{
+	int runs = 5;
+	int num_roundtrip_configs = 0;
+	int tile_kernel_iterations = 0;
+	uint32_t seed = 1;
+	string json_file;
+
+	if (argc == 5 && !strcmp(argv[1], "-g")) {
+		FpgaConfig fpga;
+		generate(fpga, argv[2], argv[3]);
+		std::ofstream ofs(argv[4], std::ios::binary);
+		if (!ofs.is_open()) {
+			fprintf(stderr, "Failed to open output file '%s'.\n", argv[4]);
+			return 1;
+		}
+		fpga.write_bits(ofs);
+		return 0;
+	}
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-r") && i+1 < argc)
+			runs = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-o") && i+1 < argc)
+			json_file = argv[++i];
+		else if (!strcmp(argv[i], "-R") && i+1 < argc)
+			num_roundtrip_configs = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-s") && i+1 < argc)
+			seed = strtoul(argv[++i], nullptr, 0);
+		else if (!strcmp(argv[i], "-k") && i+1 < argc)
+			tile_kernel_iterations = atoi(argv[++i]);
+		else {
+			fprintf(stderr, "Usage: %s [-r runs] [-o results.json]\n", argv[0]);
+			fprintf(stderr, "       %s -g <device> <random|sparse> <output.bin>\n", argv[0]);
+			fprintf(stderr, "       %s -R <num_configs> [-s seed] [-o results.json]\n", argv[0]);
+			fprintf(stderr, "       %s -k <iterations> [-r runs]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (num_roundtrip_configs > 0)
+		return run_roundtrip(num_roundtrip_configs, seed, json_file);
+
+	if (tile_kernel_iterations > 0)
+		return run_tile_kernels(tile_kernel_iterations, runs);
+
+	vector<Result> results;
+
+	printf("%-5s %-7s %-11s %10s %12s %10s %10s\n", "dev", "fill", "operation", "bytes", "ms", "MB/s", "ns/bit");
+
+	for (const char *device : devices)
+	for (const char *fill : fills)
+	{
+		FpgaConfig fpga;
+		generate(fpga, device, fill);
+
+		double num_bits = 4.0 * (fpga.cram_width * fpga.cram_height + fpga.bram_width * fpga.bram_height);
+
+		vector<uint8_t> bits;
+		fpga.write_bits(bits);
+
+		std::ostringstream asc_stream;
+		fpga.write_ascii(asc_stream);
+		string asc = asc_stream.str();
+
+		auto add_result = [&](const char *operation, size_t bytes, double seconds) {
+			Result r = { device, fill, operation, bytes, seconds, seconds * 1e9 / num_bits, bytes / seconds * 1e-6 };
+			results.push_back(r);
+			printf("%-5s %-7s %-11s %10zu %12.3f %10.1f %10.3f\n", device, fill, operation,
+					bytes, 1e3 * seconds, r.mb_per_s, r.ns_per_bit);
+		};
+
+		add_result("read_bits", bits.size(), best_time(runs, [&]() {
+			FpgaConfig config;
+			config.read_bits(bits.data(), bits.size());
+		}));
+
+		add_result("write_bits", bits.size(), best_time(runs, [&]() {
+			vector<uint8_t> data;
+			fpga.write_bits(data);
+		}));
+
+		add_result("read_ascii", asc.size(), best_time(runs, [&]() {
+			FpgaConfig config;
+			config.read_ascii(asc.data(), asc.size());
+		}));
+
+		add_result("write_ascii", asc.size(), best_time(runs, [&]() {
+			CountingBuffer buffer;
+			std::ostream os(&buffer);
+			fpga.write_ascii(os);
+		}));
+	}
+
+	if (!json_file.empty())
+	{
+		FILE *f = fopen(json_file.c_str(), "w");
+		if (f == nullptr) {
+			fprintf(stderr, "Failed to open output file '%s'.\n", json_file.c_str());
+			return 1;
+		}
+
+		fprintf(f, "{\n  \"runs\": %d,\n  \"results\": [", runs);
+		for (int i = 0; i < int(results.size()); i++) {
+			const Result &r = results[i];
+			fprintf(f, "%s\n    { \"device\": \"%s\", \"fill\": \"%s\", \"operation\": \"%s\", \"bytes\": %zu, "
+					"\"seconds\": %.9f, \"mb_per_s\": %.3f, \"ns_per_bit\": %.4f }", i ? "," : "",
+					r.device.c_str(), r.fill.c_str(), r.operation.c_str(), r.bytes, r.seconds, r.mb_per_s, r.ns_per_bit);
+		}
+		fprintf(f, "\n  ]\n}\n");
+		fclose(f);
+	}
+
+	return 0;
+}
@@ -0,0 +1,288 @@
+//
+//  Copyright (C) 2015  Clifford Wolf <clifford@clifford.at>
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted, provided that the above
+//  copyright notice and this permission notice appear in all copies.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+//  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+//  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+//  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+//  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+//  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+//  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+#include <string>
+#include <sstream>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "libicepack.h"
+#include "icepack.h"
+#include "util.h"
+
+using std::string;
+
+struct icepack_config
+{
+	FpgaConfig fpga;
+};
+
+static thread_local string last_error;
+
+// Run func with errors turned into exceptions and return 0, or record the
+// message and return -1 if it fails.
+template<typename Func>
+static int api_call(Func func)
+{
+	bool old_errors_throw = errors_throw;
+	errors_throw = true;
+
+	int ret = 0;
+	try {
+		last_error.clear();
+		func();
+	} catch (ErrorException &e) {
+		last_error = e.message;
+		ret = -1;
+	} catch (std::exception &e) {
+		last_error = stringf("Error: %s\n", e.what());
+		ret = -1;
+	}
+
+	errors_throw = old_errors_throw;
+	return ret;
+}
+
+// hand out a copy of buffer that the caller releases with free()
+static void copy_to_malloc(const std::vector<uint8_t> &buffer, uint8_t **data, size_t *len)
+{
+	*data = (uint8_t*)malloc(buffer.size());
+	if (*data == nullptr)
+		error("Out of memory.\n");
+	memcpy(*data, buffer.data(), buffer.size());
+	*len = buffer.size();
+}
+
+static void check_loaded(const icepack_config *cfg)
+{
+	if (cfg->fpga.device.empty())
+		error("No bitstream has been loaded.\n");
+}
+
+static void check_tile(const icepack_config *cfg, int tile_x, int tile_y)
+{
+	check_loaded(cfg);
+	if (tile_x < 0 || tile_x > cfg->fpga.chip_width()+1 || tile_y < 0 || tile_y > cfg->fpga.chip_height()+1)
+		error("Tile %d %d is outside of the chip.\n", tile_x, tile_y);
+}
+
+int icepack_api_version(void)
+{
+	return ICEPACK_API_VERSION;
+}
+
+void icepack_set_verbosity(int level)
+{
+	log_level = level;
+}
+
+const char *icepack_last_error(void)
+{
+	return last_error.c_str();
+}
+
+icepack_config *icepack_new(void)
+{
+	return new icepack_config;
+}
+
+void icepack_free(icepack_config *cfg)
+{
+	delete cfg;
+}
+
+int icepack_read_bits(icepack_config *cfg, const uint8_t *data, size_t len)
+{
+	return api_call([&]() {
+		FpgaConfig fpga;
+		fpga.read_bits(data, len);
+		cfg->fpga = std::move(fpga);
+	});
+}
+
+int icepack_read_ascii(icepack_config *cfg, const char *text, size_t len)
+{
+	return api_call([&]() {
+		FpgaConfig fpga;
+		fpga.read_ascii(text, len);
+		cfg->fpga = std::move(fpga);
+	});
+}
+
+int icepack_read_binary(icepack_config *cfg, const uint8_t *data, size_t len)
+{
+	return api_call([&]() {
+		FpgaConfig fpga;
+		fpga.read_binary(data, len);
+		cfg->fpga = std::move(fpga);
+	});
+}
+
+int icepack_write_bits(const icepack_config *cfg, uint8_t **data, size_t *len)
+{
+	return api_call([&]() {
+		check_loaded(cfg);
+		std::vector<uint8_t> buffer;
+		cfg->fpga.write_bits(buffer);
+		copy_to_malloc(buffer, data, len);
+	});
+}
+
+int icepack_write_ascii(const icepack_config *cfg, char **text, size_t *len)
+{
+	return api_call([&]() {
+		check_loaded(cfg);
+		std::ostringstream os;
+		cfg->fpga.write_ascii(os);
+		string buffer = os.str();
+		*text = (char*)malloc(buffer.size() + 1);
+		if (*text == nullptr)
+			error("Out of memory.\n");
+		memcpy(*text, buffer.c_str(), buffer.size() + 1);
+		*len = buffer.size();
+	});
+}
+
+int icepack_write_binary(const icepack_config *cfg, uint8_t **data, size_t *len)
+{
+	return api_call([&]() {
+		check_loaded(cfg);
+		std::vector<uint8_t> buffer;
+		cfg->fpga.write_binary(buffer);
+		copy_to_malloc(buffer, data, len);
+	});
+}
+
+int icepack_is_binary(const void *data, size_t len)
+{
+	return FpgaConfig::is_binary(data, len);
+}
+
+void icepack_free_buffer(void *buffer)
+{
+	free(buffer);
+}
+
+const char *icepack_device(const icepack_config *cfg)
+{
+	return cfg->fpga.device.c_str();
+}
+
+int icepack_tiles_x(const icepack_config *cfg)
+{
+	int ret = -1;
+	api_call([&]() {
+		check_loaded(cfg);
+		ret = cfg->fpga.chip_width() + 2;
+	});
+	return ret;
+}
+
+int icepack_tiles_y(const icepack_config *cfg)
+{
+	int ret = -1;
+	api_call([&]() {
+		check_loaded(cfg);
+		ret = cfg->fpga.chip_height() + 2;
+	});
+	return ret;
+}
+
+int icepack_tile_width(const icepack_config *cfg, int tile_x, int tile_y)
+{
+	int ret = -1;
+	api_call([&]() {
+		check_tile(cfg, tile_x, tile_y);
+		ret = DeviceGeometry::tile_width(cfg->fpga.geometry().tile_type(tile_x, tile_y));
+	});
+	return ret;
+}
+
+// bank and position of config bit (bit_x, bit_y) of a tile
+static int tile_bit(const icepack_config *cfg, int tile_x, int tile_y, int bit_x, int bit_y, int &bank_x, int &bank_y)
+{
+	check_tile(cfg, tile_x, tile_y);
+	CramIndexConverter cic(&cfg->fpga, tile_x, tile_y);
+
+	if (bit_x < 0 || bit_x >= cic.tile_width || bit_y < 0 || bit_y >= 16)
+		error("Bit %d %d is outside of tile %d %d.\n", bit_x, bit_y, tile_x, tile_y);
+
+	int bank;
+	cic.get_cram_index(bit_x, bit_y, bank, bank_x, bank_y);
+	return bank;
+}
+
+// bank and position of bit (bit_x, bit_y) of the .ram_data section of a tile
+static int bram_bit(const icepack_config *cfg, int tile_x, int tile_y, int bit_x, int bit_y, int &bank_x, int &bank_y)
+{
+	check_tile(cfg, tile_x, tile_y);
+
+	if (cfg->fpga.geometry().tile_type(tile_x, tile_y) != TILE_RAMB)
+		error("Tile %d %d is not a ramb tile.\n", tile_x, tile_y);
+
+	if (bit_x < 0 || bit_x >= 256 || bit_y < 0 || bit_y >= 16)
+		error("Bit %d %d is outside of the ram data of tile %d %d.\n", bit_x, bit_y, tile_x, tile_y);
+
+	BramIndexConverter bic(&cfg->fpga, tile_x, tile_y);
+
+	int bank;
+	bic.get_bram_index(bit_x, bit_y, bank, bank_x, bank_y);
+	if (bank_x >= cfg->fpga.bram_width || bank_y >= cfg->fpga.bram_height)
+		error("Tile %d %d has no ram data in this bitstream.\n", tile_x, tile_y);
+
+	return bank;
+}
+
+int icepack_get_tile_bit(const icepack_config *cfg, int tile_x, int tile_y, int bit_x, int bit_y)
+{
+	int ret = -1;
+	api_call([&]() {
+		int bank_x, bank_y;
+		int bank = tile_bit(cfg, tile_x, tile_y, bit_x, bit_y, bank_x, bank_y);
+		ret = cfg->fpga.cram[bank].get(bank_x, bank_y);
+	});
+	return ret;
+}
+
+int icepack_set_tile_bit(icepack_config *cfg, int tile_x, int tile_y, int bit_x, int bit_y, int value)
+{
+	return api_call([&]() {
+		int bank_x, bank_y;
+		int bank = tile_bit(cfg, tile_x, tile_y, bit_x, bit_y, bank_x, bank_y);
+		cfg->fpga.cram[bank].set(bank_x, bank_y, value != 0);
+	});
+}
+
+int icepack_get_bram_bit(const icepack_config *cfg, int tile_x, int tile_y, int bit_x, int bit_y)
+{
+	int ret = -1;
+	api_call([&]() {
+		int bank_x, bank_y;
+		int bank = bram_bit(cfg, tile_x, tile_y, bit_x, bit_y, bank_x, bank_y);
+		ret = cfg->fpga.bram[bank].get(bank_x, bank_y);
+	});
+	return ret;
+}
+
+int icepack_set_bram_bit(icepack_config *cfg, int tile_x, int tile_y, int bit_x, int bit_y, int value)
+{
+	return api_call([&]() {
+		int bank_x, bank_y;
+		int bank = bram_bit(cfg, tile_x, tile_y, bit_x, bit_y, bank_x, bank_y);
+		cfg->fpga.bram[bank].set(bank_x, bank_y, value != 0);
+	});
+}
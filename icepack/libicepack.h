@@ -0,0 +1,86 @@
+//
+//  Copyright (C) 2015  Clifford Wolf <clifford@clifford.at>
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted, provided that the above
+//  copyright notice and this permission notice appear in all copies.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+//  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+//  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+//  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+//  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+//  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+//  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+/*
+ * C interface of libicepack. All functions returning int return a negative
+ * value on error; icepack_last_error() then returns the error message. Errors
+ * never terminate the calling process. An icepack_config must only be used
+ * by one thread at a time, different configs may be used concurrently.
+ */
+
+#ifndef LIBICEPACK_H
+#define LIBICEPACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ICEPACK_API_VERSION 2
+
+typedef struct icepack_config icepack_config;
+
+/* returns ICEPACK_API_VERSION of the library that is actually loaded */
+int icepack_api_version(void);
+
+/* 0 = errors only, 1 = info, 2 = debug messages on stderr */
+void icepack_set_verbosity(int level);
+
+/* message of the last failed call on the calling thread, or "" */
+const char *icepack_last_error(void);
+
+icepack_config *icepack_new(void);
+void icepack_free(icepack_config *cfg);
+
+/* load a bitstream (.bin), icebox (.asc) or binary config file from memory */
+int icepack_read_bits(icepack_config *cfg, const uint8_t *data, size_t len);
+int icepack_read_ascii(icepack_config *cfg, const char *text, size_t len);
+int icepack_read_binary(icepack_config *cfg, const uint8_t *data, size_t len);
+
+/* write a bitstream, icebox or binary config file to a new buffer, release it with icepack_free_buffer() */
+int icepack_write_bits(const icepack_config *cfg, uint8_t **data, size_t *len);
+int icepack_write_ascii(const icepack_config *cfg, char **text, size_t *len);
+int icepack_write_binary(const icepack_config *cfg, uint8_t **data, size_t *len);
+
+/* non-zero if the buffer holds a binary config file */
+int icepack_is_binary(const void *data, size_t len);
+void icepack_free_buffer(void *buffer);
+
+/* device type ("384", "1k", "8k"), or "" if nothing has been loaded */
+const char *icepack_device(const icepack_config *cfg);
+
+/* size of the chip in tiles, including the io tiles at the border */
+int icepack_tiles_x(const icepack_config *cfg);
+int icepack_tiles_y(const icepack_config *cfg);
+
+/* width of the tile in config bits (0 for corner tiles), the height is always 16 */
+int icepack_tile_width(const icepack_config *cfg, int tile_x, int tile_y);
+
+/* config bit B<bit_y>[<bit_x>] of a tile, as in the .asc tile sections */
+int icepack_get_tile_bit(const icepack_config *cfg, int tile_x, int tile_y, int bit_x, int bit_y);
+int icepack_set_tile_bit(icepack_config *cfg, int tile_x, int tile_y, int bit_x, int bit_y, int value);
+
+/* bit <bit_x> of row <bit_y> (0..15) of the .ram_data section of a ramb tile */
+int icepack_get_bram_bit(const icepack_config *cfg, int tile_x, int tile_y, int bit_x, int bit_y);
+int icepack_set_bram_bit(icepack_config *cfg, int tile_x, int tile_y, int bit_x, int bit_y, int value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,35 @@
+//
+//  Copyright (C) 2015  Clifford Wolf <clifford@clifford.at>
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted, provided that the above
+//  copyright notice and this permission notice appear in all copies.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+//  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+//  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+//  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+//  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+//  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+//  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+#ifndef TILEKERNELS_H
+#define TILEKERNELS_H
+
+#include "icepack.h"
+
+// Per-tile inner loop of the .asc writer. The tile width is the only
+// runtime size left in this loop (all device geometry is in the index
+// tables), so every device uses the same three specializations for io (18),
+// ram (42) and logic (54) tiles.
+
+// render the 16 rows of config bits of a tile as '0'/'1' characters, each
+// row followed by '\n'. writes 16 * (cic.tile_width + 1) bytes to out.
+void render_tile_bits(const FpgaConfig *fpga, const CramIndexConverter &cic, char *out);
+
+// the same with the tile width taken from cic at runtime (for testing and
+// benchmarking)
+void render_tile_bits_generic(const FpgaConfig *fpga, const CramIndexConverter &cic, char *out);
+
+#endif
@@ -0,0 +1,216 @@
+//
+//  Copyright (C) 2015  Clifford Wolf <clifford@clifford.at>
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted, provided that the above
+//  copyright notice and this permission notice appear in all copies.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+//  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+//  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+//  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+//  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+//  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+//  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+#if !defined(_WIN32) && !defined(_GNU_SOURCE)
+// for vasprintf()
+#define _GNU_SOURCE
+#endif
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "util.h"
+
+using std::vector;
+using std::string;
+
+thread_local bool errors_throw = false;
+
+namespace icepack_util {
+
+int log_level = 0;
+
+bool stats_enabled = false;
+std::atomic<uint64_t> stat_timer_ns[NUM_TIMERS], stat_timer_calls[NUM_TIMERS];
+std::atomic<uint64_t> stat_counters[NUM_COUNTERS];
+
+static const char *stat_timer_names[NUM_TIMERS] = {
+	"read_input", "read_bits", "preamble", "bank_data", "crc",
+	"read_ascii", "write_bits", "write_ascii", "format_ascii", "write_output"
+};
+
+static const char *stat_counter_names[NUM_COUNTERS] = {
+	"bytes_decoded", "bytes_parsed", "bytes_written", "bits_set", "tiles_emitted", "allocations"
+};
+
+void error_exit(const string &message)
+{
+	if (errors_throw)
+		throw ErrorException{message};
+	fputs(message.c_str(), stderr);
+	exit(1);
+}
+
+string vstringf(const char *fmt, va_list ap)
+{
+	string string;
+	char *str = NULL;
+
+#ifdef _WIN32
+	int sz = 64, rc;
+	while (1) {
+		va_list apc;
+		va_copy(apc, ap);
+		str = (char*)realloc(str, sz);
+		rc = vsnprintf(str, sz, fmt, apc);
+		va_end(apc);
+		if (rc >= 0 && rc < sz)
+			break;
+		sz *= 2;
+	}
+#else
+	if (vasprintf(&str, fmt, ap) < 0)
+		str = NULL;
+#endif
+
+	if (str != NULL) {
+		string = str;
+		free(str);
+	}
+
+	return string;
+}
+
+string stringf(const char *fmt, ...)
+{
+	string string;
+	va_list ap;
+
+	va_start(ap, fmt);
+	string = vstringf(fmt, ap);
+	va_end(ap);
+
+	return string;
+}
+
+// Errors in func() are always thrown inside the workers (errors_throw is
+// thread_local and not inherited by new threads). The first one stops the
+// remaining work and is passed on to error_exit() on the calling thread
+// after all workers have finished, so it is thrown or printed there.
+void parallel_for(int n, int num_threads, const std::function<void(int)> &func)
+{
+	std::atomic<int> next_index(0);
+	std::mutex error_mutex;
+	bool have_error = false;
+	string error_message;
+
+	auto worker = [&]() {
+		bool old_errors_throw = errors_throw;
+		errors_throw = true;
+		try {
+			for (int i = next_index++; i < n; i = next_index++)
+				func(i);
+		} catch (ErrorException &e) {
+			std::lock_guard<std::mutex> lock(error_mutex);
+			if (!have_error)
+				have_error = true, error_message = e.message;
+			next_index = n;
+		}
+		errors_throw = old_errors_throw;
+	};
+
+	vector<std::thread> threads;
+	for (int i = 1; i < std::min(num_threads, n); i++)
+		threads.push_back(std::thread(worker));
+
+	worker();
+
+	for (auto &thread : threads)
+		thread.join();
+
+	if (have_error)
+		error_exit(error_message);
+}
+
+bool MappedFile::open(const string &filename)
+{
+	close();
+
+#ifdef _WIN32
+	return false;
+#else
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+
+	void *ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+
+	if (ptr == MAP_FAILED)
+		return false;
+
+	madvise(ptr, st.st_size, MADV_SEQUENTIAL);
+
+	this->data = static_cast<const uint8_t*>(ptr);
+	this->size = st.st_size;
+	return true;
+#endif
+}
+
+void MappedFile::close()
+{
+#ifndef _WIN32
+	if (this->data != nullptr)
+		munmap(const_cast<uint8_t*>(this->data), this->size);
+#endif
+	this->data = nullptr;
+	this->size = 0;
+}
+
+void write_stats_summary(FILE *f)
+{
+	fprintf(f, "\n%-16s %12s %10s\n", "timer", "ms", "calls");
+	for (int i = 0; i < NUM_TIMERS; i++)
+		if (stat_timer_calls[i] != 0)
+			fprintf(f, "%-16s %12.3f %10llu\n", stat_timer_names[i], 1e-6 * stat_timer_ns[i],
+					(unsigned long long)stat_timer_calls[i]);
+
+	fprintf(f, "\n%-16s %12s\n", "counter", "value");
+	for (int i = 0; i < NUM_COUNTERS; i++)
+		fprintf(f, "%-16s %12llu\n", stat_counter_names[i], (unsigned long long)stat_counters[i]);
+}
+
+void write_stats_json(FILE *f)
+{
+	fprintf(f, "{\n  \"timers\": {");
+	for (int i = 0; i < NUM_TIMERS; i++)
+		fprintf(f, "%s\n    \"%s\": { \"seconds\": %.9f, \"calls\": %llu }", i ? "," : "", stat_timer_names[i],
+				1e-9 * stat_timer_ns[i], (unsigned long long)stat_timer_calls[i]);
+
+	fprintf(f, "\n  },\n  \"counters\": {");
+	for (int i = 0; i < NUM_COUNTERS; i++)
+		fprintf(f, "%s\n    \"%s\": %llu", i ? "," : "", stat_counter_names[i], (unsigned long long)stat_counters[i]);
+
+	fprintf(f, "\n  }\n}\n");
+}
+
+}
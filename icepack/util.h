@@ -0,0 +1,145 @@
+//
+//  Copyright (C) 2015  Clifford Wolf <clifford@clifford.at>
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted, provided that the above
+//  copyright notice and this permission notice appear in all copies.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+//  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+//  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+//  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+//  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+//  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+//  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+//
+
+// Logging, error handling and other helpers shared by the icepack sources.
+// This header is private to icepack and libicepack and is not installed.
+
+#ifndef ICEPACK_UTIL_H
+#define ICEPACK_UTIL_H
+
+#include <functional>
+#include <string>
+#include <chrono>
+#include <atomic>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+
+#include "icepack.h"
+
+#ifdef _WIN32
+#define __PRETTY_FUNCTION__ __FUNCTION__
+#endif
+
+// in a namespace so that the library does not clash with the same helpers
+// in programs that link against it
+namespace icepack_util {
+
+extern int log_level;
+
+// print the message and exit, or throw an ErrorException (see errors_throw)
+[[noreturn]] void error_exit(const std::string &message);
+
+std::string vstringf(const char *fmt, va_list ap);
+std::string stringf(const char *fmt, ...);
+
+// run func(0) .. func(n-1), spread over up to num_threads threads
+void parallel_for(int n, int num_threads, const std::function<void(int)> &func);
+
+// A regular file mapped read-only into memory. open() returns false if the
+// file cannot be mapped (not a regular file, empty, no mmap() on this
+// platform, ..), the caller then reads it as a stream instead.
+struct MappedFile
+{
+	const uint8_t *data = nullptr;
+	size_t size = 0;
+
+	MappedFile() { }
+	MappedFile(const MappedFile&) = delete;
+	MappedFile &operator=(const MappedFile&) = delete;
+	~MappedFile() { close(); }
+
+	bool open(const std::string &filename);
+	void close();
+};
+
+// Timers and event counters for the icepack -T/-J reports. Nothing is
+// recorded unless stats_enabled is set before the work starts. Timers of
+// nested phases overlap, e.g. "crc" is part of "read_bits" and "write_bits".
+
+enum StatTimer {
+	TIMER_READ_INPUT,
+	TIMER_READ_BITS,
+	TIMER_PREAMBLE,
+	TIMER_BANK_DATA,
+	TIMER_CRC,
+	TIMER_READ_ASCII,
+	TIMER_WRITE_BITS,
+	TIMER_WRITE_ASCII,
+	TIMER_FORMAT_ASCII,
+	TIMER_WRITE_OUTPUT,
+	NUM_TIMERS
+};
+
+enum StatCounter {
+	COUNTER_BYTES_DECODED,
+	COUNTER_BYTES_PARSED,
+	COUNTER_BYTES_WRITTEN,
+	COUNTER_BITS_SET,
+	COUNTER_TILES_EMITTED,
+	COUNTER_ALLOCATIONS,
+	NUM_COUNTERS
+};
+
+extern bool stats_enabled;
+extern std::atomic<uint64_t> stat_timer_ns[NUM_TIMERS], stat_timer_calls[NUM_TIMERS];
+extern std::atomic<uint64_t> stat_counters[NUM_COUNTERS];
+
+static inline void stat_add(StatCounter counter, uint64_t value)
+{
+	if (stats_enabled)
+		stat_counters[counter].fetch_add(value, std::memory_order_relaxed);
+}
+
+struct ScopedTimer
+{
+	StatTimer timer;
+	bool active;
+	std::chrono::steady_clock::time_point start;
+
+	ScopedTimer(StatTimer timer) : timer(timer), active(stats_enabled) {
+		if (active)
+			start = std::chrono::steady_clock::now();
+	}
+
+	ScopedTimer(const ScopedTimer&) = delete;
+	ScopedTimer &operator=(const ScopedTimer&) = delete;
+
+	~ScopedTimer() {
+		if (!active)
+			return;
+		auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		stat_timer_ns[timer].fetch_add(ns, std::memory_order_relaxed);
+		stat_timer_calls[timer].fetch_add(1, std::memory_order_relaxed);
+	}
+};
+
+// human readable table and JSON object with all timers and counters
+void write_stats_summary(FILE *f);
+void write_stats_json(FILE *f);
+
+}
+
+using namespace icepack_util;
+
+#define log(...) fprintf(stderr, __VA_ARGS__);
+#define info(...) do { if (log_level > 0) fprintf(stderr, __VA_ARGS__); } while (0)
+#define debug(...) do { if (log_level > 1) fprintf(stderr, __VA_ARGS__); } while (0)
+#define error(...) error_exit(stringf("Error: " __VA_ARGS__))
+#define panic(fmt, ...) do { fprintf(stderr, "Internal Error at %s:%d: " fmt, __FILE__, __LINE__, ##__VA_ARGS__); abort(); } while (0)
+
+#endif
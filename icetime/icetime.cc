@@ -32,6 +32,15 @@
 #include <tuple>
 #include <map>
 #include <set>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "../icepack/icepack.h"
 
 // add this number of ns as estimate for clock distribution mismatch
 #define GLOBAL_CLK_DIST_JITTER 0.1
@@ -42,9 +51,11 @@ bool verbose = false;
 bool max_span_hack = false;
 bool json_firstentry = true;
 
-std::string config_device, device_type, selected_package, chipdbfile;
-std::vector<std::vector<std::string>> config_tile_type;
-std::vector<std::vector<std::vector<std::vector<bool>>>> config_bits;
+std::string config_device, device_type, selected_package, chipdbfile, chipdb_cache_file;
+// tile types and config bits, indexed by [tile_x][tile_y]. the config bits
+// of a tile are packed, bit B<row>[<col>] is config_bits[x][y].get(col, row).
+std::vector<std::vector<TileType>> config_tile_type;
+std::vector<std::vector<BitPlane>> config_bits;
 std::map<std::tuple<int, int, int>, std::string> pin_pos;
 std::map<std::string, std::string> pin_names;
 std::set<std::tuple<int, int, int>> extra_bits;
@@ -248,13 +259,13 @@ void read_config()
 				}
 
 				if (!strcmp(tok, ".io_tile"))
-					config_tile_type.at(tile_x).at(tile_y) = "io";
+					config_tile_type.at(tile_x).at(tile_y) = TILE_IO;
 				if (!strcmp(tok, ".logic_tile"))
-					config_tile_type.at(tile_x).at(tile_y) = "logic";
+					config_tile_type.at(tile_x).at(tile_y) = TILE_LOGIC;
 				if (!strcmp(tok, ".ramb_tile"))
-					config_tile_type.at(tile_x).at(tile_y) = "ramb";
+					config_tile_type.at(tile_x).at(tile_y) = TILE_RAMB;
 				if (!strcmp(tok, ".ramt_tile"))
-					config_tile_type.at(tile_x).at(tile_y) = "ramt";
+					config_tile_type.at(tile_x).at(tile_y) = TILE_RAMT;
 			} else
 			if (!strcmp(tok, ".extra_bit")) {
 				int b = atoi(strtok(nullptr, " \t\r\n"));
@@ -271,63 +282,288 @@ void read_config()
 		} else
 		if (line_nr >= 0)
 		{
-			assert(int(config_bits.at(tile_x).at(tile_y).size()) == line_nr);
-			config_bits.at(tile_x).at(tile_y).resize(line_nr+1);
-			for (int i = 0; buffer[i] == '0' || buffer[i] == '1'; i++)
-				config_bits.at(tile_x).at(tile_y).at(line_nr).push_back(buffer[i] == '1');
+			auto &bits = config_bits.at(tile_x).at(tile_y);
+			assert(bits.height == line_nr);
+
+			int width = 0;
+			while (buffer[width] == '0' || buffer[width] == '1')
+				width++;
+
+			bits.resize(line_nr == 0 ? width : bits.width, line_nr+1);
+			for (int i = 0; i < width && i < bits.width; i++)
+				if (buffer[i] == '1')
+					bits.set(i, line_nr);
 			line_nr++;
 		}
 	}
 }
 
-void read_chipdb()
+// same as read_config(), but for a binary config file written by icepack -C
+void read_config_binary()
 {
-	char buffer[1024];
+	std::vector<uint8_t> data;
+	uint8_t buffer[65536];
+	for (size_t n; (n = fread(buffer, 1, sizeof(buffer), fin)) > 0;)
+		data.insert(data.end(), buffer, buffer + n);
 
-	if (!chipdbfile.empty()) {
-		snprintf(buffer, 1024, "%s", chipdbfile.c_str());
-	} else
-	if (PREFIX[0] == '~' && PREFIX[1] == '/') {
-		std::string homedir;
-#ifdef _WIN32
-		if (getenv("USERPROFILE") != nullptr) {
-			homedir += getenv("USERPROFILE");
+	FpgaConfig fpga;
+	fpga.read_binary(data.data(), data.size());
+
+	config_device = fpga.device;
+
+	int tiles_x = fpga.chip_width() + 2;
+	int tiles_y = fpga.chip_height() + 2;
+
+	config_tile_type.assign(tiles_x, std::vector<TileType>(tiles_y, TILE_CORNER));
+	config_bits.assign(tiles_x, std::vector<BitPlane>(tiles_y));
+
+	for (int tile_x = 0; tile_x < tiles_x; tile_x++)
+	for (int tile_y = 0; tile_y < tiles_y; tile_y++)
+	{
+		CramIndexConverter cic(&fpga, tile_x, tile_y);
+
+		if (cic.tile_type == TILE_CORNER)
+			continue;
+
+		config_tile_type[tile_x][tile_y] = cic.tile_type;
+		auto &bits = config_bits[tile_x][tile_y];
+		bits.resize(cic.tile_width, 16);
+
+		for (int bit_y = 0; bit_y < 16; bit_y++)
+		for (int bit_x = 0; bit_x < cic.tile_width; bit_x++) {
+			int cram_bank, cram_x, cram_y;
+			cic.get_cram_index(bit_x, bit_y, cram_bank, cram_x, cram_y);
+			if (fpga.cram[cram_bank].get(cram_x, cram_y))
+				bits.set(bit_x, bit_y);
 		}
-		else {
-			if (getenv("HOMEDRIVE") != nullptr &&
-			    getenv("HOMEPATH") != nullptr) {
-				homedir += getenv("HOMEDRIVE");
-				homedir += getenv("HOMEPATH");
+	}
+
+	std::vector<BankIndex> fpga_extra_bits;
+	fpga.get_extra_bits(fpga_extra_bits);
+
+	for (auto &idx : fpga_extra_bits)
+		extra_bits.insert(std::tuple<int, int, int>(idx.bank, idx.x, idx.y));
+}
+
+// ==================================================================
+// Chip database
+//
+// The text chipdb is compiled into flat tables: interned names, the segments
+// of each net in CSR form (net_segments[net] .. net_segments[net+1] index the
+// segments of a net), and the .buffer/.routing entries with their config bits
+// and the config patterns, packed into integers, that connect each source net.
+// The entries are kept in file order. With -B the tables are written to a
+// cache file once and mapped into memory on later runs. The cache stores the
+// size and a hash of the text chipdb and is rebuilt when they do not match.
+
+enum {
+	CHIPDB_NAME_OFFSETS,
+	CHIPDB_NAME_CHARS,
+	CHIPDB_NET_SEGMENTS,
+	CHIPDB_SEGMENTS,
+	CHIPDB_CONNECTIONS,
+	CHIPDB_BITS,
+	CHIPDB_PATTERNS,
+	CHIPDB_PINS,
+	CHIPDB_GBUFIN,
+	CHIPDB_TILE_BITS,
+	CHIPDB_NUM_SECTIONS
+};
+
+struct chipdb_segment_t {
+	int32_t x, y, name;
+};
+
+// .buffer or .routing entry. the net is connected to patterns[i].net if the
+// config bits bits[bits_begin .. bits_end-1], first bit in the most
+// significant position, have the value patterns[i].value.
+struct chipdb_connection_t {
+	int32_t x, y, net, routing;
+	uint32_t bits_begin, bits_end, patterns_begin, patterns_end;
+};
+
+struct chipdb_bit_t {
+	int16_t row, col;
+};
+
+struct chipdb_pattern_t {
+	uint32_t value;
+	int32_t net;
+};
+
+struct chipdb_pin_t {
+	int32_t package, name, x, y, z;
+};
+
+struct chipdb_gbufin_t {
+	int32_t x, y, glb;
+};
+
+struct chipdb_tile_bits_t {
+	int32_t tile_type, name;
+	uint32_t bits_begin, bits_end;
+};
+
+static const size_t chipdb_element_size[CHIPDB_NUM_SECTIONS] = {
+	sizeof(uint32_t), sizeof(char), sizeof(uint32_t), sizeof(chipdb_segment_t), sizeof(chipdb_connection_t),
+	sizeof(chipdb_bit_t), sizeof(chipdb_pattern_t), sizeof(chipdb_pin_t), sizeof(chipdb_gbufin_t), sizeof(chipdb_tile_bits_t)
+};
+
+// The cache is a dump of the tables in the native layout. The header records
+// the byte order, a layout version (bump it when the tables change) and the
+// record sizes, so that a cache from another build or machine is rebuilt.
+#define CHIPDB_CACHE_MAGIC "icecdb\0\0"
+#define CHIPDB_CACHE_BYTE_ORDER 0x01020304
+#define CHIPDB_CACHE_VERSION 3
+
+struct chipdb_header_t {
+	char magic[8];
+	uint32_t byte_order, version;
+	uint32_t element_size[CHIPDB_NUM_SECTIONS];
+	uint64_t source_size, source_hash;
+	uint64_t offset[CHIPDB_NUM_SECTIONS], count[CHIPDB_NUM_SECTIONS];
+};
+
+// the tables, either in a mapped cache file or in the vectors of a chipdb_builder_t
+struct chipdb_t
+{
+	const void *data[CHIPDB_NUM_SECTIONS];
+	uint64_t count[CHIPDB_NUM_SECTIONS];
+
+	template<typename T> const T *table(int section) const {
+		return static_cast<const T*>(data[section]);
+	}
+
+	const char *name(int id) const {
+		return table<char>(CHIPDB_NAME_CHARS) + table<uint32_t>(CHIPDB_NAME_OFFSETS)[id];
+	}
+};
+
+struct chipdb_builder_t
+{
+	std::vector<uint32_t> name_offsets;
+	std::vector<char> name_chars;
+	std::vector<uint32_t> net_segments;
+	std::vector<chipdb_segment_t> segments;
+	std::vector<chipdb_connection_t> connections;
+	std::vector<chipdb_bit_t> bits;
+	std::vector<chipdb_pattern_t> patterns;
+	std::vector<chipdb_pin_t> pins;
+	std::vector<chipdb_gbufin_t> gbufin;
+	std::vector<chipdb_tile_bits_t> tile_bits;
+
+	std::unordered_map<std::string, int> name_ids;
+
+	int intern(const char *name) {
+		auto it = name_ids.find(name);
+		if (it != name_ids.end())
+			return it->second;
+		int id = name_offsets.size();
+		name_ids[name] = id;
+		name_offsets.push_back(name_chars.size());
+		name_chars.insert(name_chars.end(), name, name + strlen(name) + 1);
+		return id;
+	}
+
+	void get(chipdb_t &db) const {
+		const void *data[CHIPDB_NUM_SECTIONS] = {
+			name_offsets.data(), name_chars.data(), net_segments.data(), segments.data(), connections.data(),
+			bits.data(), patterns.data(), pins.data(), gbufin.data(), tile_bits.data()
+		};
+		uint64_t count[CHIPDB_NUM_SECTIONS] = {
+			name_offsets.size(), name_chars.size(), net_segments.size(), segments.size(), connections.size(),
+			bits.size(), patterns.size(), pins.size(), gbufin.size(), tile_bits.size()
+		};
+		for (int i = 0; i < CHIPDB_NUM_SECTIONS; i++)
+			db.data[i] = data[i], db.count[i] = count[i];
+	}
+};
+
+// contents of a file, mapped into memory where possible
+struct file_data_t
+{
+	const uint8_t *data = nullptr;
+	size_t size = 0;
+	std::vector<uint8_t> buffer;
+	bool mapped = false;
+
+	file_data_t() { }
+	file_data_t(const file_data_t&) = delete;
+	file_data_t &operator=(const file_data_t&) = delete;
+
+	~file_data_t() {
+#ifndef _WIN32
+		if (mapped)
+			munmap(const_cast<uint8_t*>(data), size);
+#endif
+	}
+
+	bool open(const char *filename)
+	{
+#ifndef _WIN32
+		int fd = ::open(filename, O_RDONLY);
+		if (fd < 0)
+			return false;
+
+		struct stat st;
+		if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+			void *ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (ptr != MAP_FAILED) {
+				::close(fd);
+				data = static_cast<const uint8_t*>(ptr);
+				size = st.st_size;
+				mapped = true;
+				return true;
 			}
 		}
-#else
-		homedir += getenv("HOME");
+		::close(fd);
 #endif
-		snprintf(buffer, 1024, "%s%s/share/" CHIPDB_SUBDIR "/chipdb-%s.txt", homedir.c_str(), PREFIX+1, config_device.c_str());
-	} else
-		snprintf(buffer, 1024, PREFIX "/share/" CHIPDB_SUBDIR "/chipdb-%s.txt", config_device.c_str());
-
-	FILE *fdb = fopen(buffer, "r");
-	if (fdb == nullptr) {
-		perror("Can't open chipdb file");
-		exit(1);
+		FILE *f = fopen(filename, "rb");
+		if (f == nullptr)
+			return false;
+		uint8_t chunk[65536];
+		for (size_t n; (n = fread(chunk, 1, sizeof(chunk), f)) > 0;)
+			buffer.insert(buffer.end(), chunk, chunk + n);
+		fclose(f);
+		data = buffer.data();
+		size = buffer.size();
+		return true;
 	}
+};
 
-	std::string mode;
-	int current_net = -1;
-	int tile_x = -1, tile_y = -1;
-	std::string thiscfg;
+// FNV-1a over 64 bit words, to detect changes of the text chipdb
+uint64_t chipdb_hash(const uint8_t *data, size_t len)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (; len >= 8; data += 8, len -= 8) {
+		uint64_t word;
+		memcpy(&word, data, 8);
+		hash = (hash ^ word) * 0x100000001b3ULL;
+	}
+	for (; len > 0; data++, len--)
+		hash = (hash ^ *data) * 0x100000001b3ULL;
+	return hash;
+}
 
-	std::vector<std::vector<int>> gbufin;
-	std::vector<std::vector<int>> gbufpin;
-	std::set<std::string> extrabitfunc;
+void compile_chipdb(const char *text, size_t text_len, chipdb_builder_t &db)
+{
+	const char *end = text + text_len;
+	std::string line, mode;
+	int current_net = -1, current_package = -1;
+	std::vector<std::vector<chipdb_segment_t>> net_segments;
 
-	while (fgets(buffer, 1024, fdb))
+	for (const char *p = text; p < end;)
 	{
-		if (buffer[0] == '#')
+		const char *eol = static_cast<const char*>(memchr(p, '\n', end - p));
+		if (eol == nullptr)
+			eol = end;
+		line.assign(p, eol);
+		p = eol + 1;
+
+		if (line.empty() || line[0] == '#')
 			continue;
 
-		const char *tok = strtok(buffer, " \t\r\n");
+		const char *tok = strtok(&line[0], " \t\r\n");
 		if (tok == nullptr)
 			continue;
 
@@ -336,144 +572,319 @@ void read_chipdb()
 			mode = tok;
 
 			if (mode == ".pins")
-			{
-				if (strtok(nullptr, " \t\r\n") != selected_package)
-					mode = "";
-				continue;
-			}
+				current_package = db.intern(strtok(nullptr, " \t\r\n"));
 
 			if (mode == ".net")
-			{
 				current_net = atoi(strtok(nullptr, " \t\r\n"));
-				continue;
-			}
 
 			if (mode == ".buffer" || mode == ".routing")
 			{
-				tile_x = atoi(strtok(nullptr, " \t\r\n"));
-				tile_y = atoi(strtok(nullptr, " \t\r\n"));
-				current_net = atoi(strtok(nullptr, " \t\r\n"));
+				chipdb_connection_t conn;
+				conn.x = atoi(strtok(nullptr, " \t\r\n"));
+				conn.y = atoi(strtok(nullptr, " \t\r\n"));
+				conn.net = atoi(strtok(nullptr, " \t\r\n"));
+				conn.routing = mode == ".routing";
+				conn.bits_begin = db.bits.size();
+				conn.patterns_begin = conn.patterns_end = db.patterns.size();
 
-				thiscfg = "";
 				while ((tok = strtok(nullptr, " \t\r\n")) != nullptr) {
 					int bit_row, bit_col, rc;
 					rc = sscanf(tok, "B%d[%d]", &bit_row, &bit_col);
 					assert(rc == 2);
-					thiscfg.push_back(config_bits[tile_x][tile_y][bit_row][bit_col] ? '1' : '0');
+					db.bits.push_back(chipdb_bit_t{int16_t(bit_row), int16_t(bit_col)});
 				}
-				continue;
+
+				conn.bits_end = db.bits.size();
+				assert(conn.bits_end - conn.bits_begin <= 32);
+				db.connections.push_back(conn);
 			}
 
 			continue;
 		}
 
 		if (mode == ".pins") {
-			int pos_x = atoi(strtok(nullptr, " \t\r\n"));
-			int pos_y = atoi(strtok(nullptr, " \t\r\n"));
-			int pos_z = atoi(strtok(nullptr, " \t\r\n"));
-			std::tuple<int, int, int> key(pos_x, pos_y, pos_z);
-			pin_pos[key] = tok;
+			chipdb_pin_t pin;
+			pin.package = current_package;
+			pin.name = db.intern(tok);
+			pin.x = atoi(strtok(nullptr, " \t\r\n"));
+			pin.y = atoi(strtok(nullptr, " \t\r\n"));
+			pin.z = atoi(strtok(nullptr, " \t\r\n"));
+			db.pins.push_back(pin);
 		}
 
 		if (mode == ".net") {
-			int tile_x = atoi(tok);
-			int tile_y = atoi(strtok(nullptr, " \t\r\n"));
-			std::string segment_name = strtok(nullptr, " \t\r\n");
-			net_segment_t seg(tile_x, tile_y, current_net, segment_name);
-			std::tuple<int, int, std::string> x_y_name(tile_x, tile_y, segment_name);
-			net_to_segments[current_net].insert(seg);
-			segments.insert(seg);
-		}
-
-		if (mode == ".buffer" && !strcmp(tok, thiscfg.c_str())) {
-			int other_net = atoi(strtok(nullptr, " \t\r\n"));
-			net_rbuffers[current_net].insert(other_net);
-			net_buffers[other_net].insert(current_net);
-			connection_pos[std::pair<int, int>(current_net, other_net)] =
-					connection_pos[std::pair<int, int>(other_net, current_net)] =
-					std::pair<int, int>(tile_x, tile_y);
-			used_nets.insert(current_net);
-			used_nets.insert(other_net);
+			chipdb_segment_t seg;
+			seg.x = atoi(tok);
+			seg.y = atoi(strtok(nullptr, " \t\r\n"));
+			seg.name = db.intern(strtok(nullptr, " \t\r\n"));
+			if (current_net >= int(net_segments.size()))
+				net_segments.resize(current_net+1);
+			net_segments[current_net].push_back(seg);
 		}
 
-		if (mode == ".routing" && !strcmp(tok, thiscfg.c_str())) {
-			int other_net = atoi(strtok(nullptr, " \t\r\n"));
-			net_routing[current_net].insert(other_net);
-			net_routing[other_net].insert(current_net);
-			connection_pos[std::pair<int, int>(current_net, other_net)] =
-					connection_pos[std::pair<int, int>(other_net, current_net)] =
-					std::pair<int, int>(tile_x, tile_y);
-			used_nets.insert(current_net);
-			used_nets.insert(other_net);
+		if (mode == ".buffer" || mode == ".routing") {
+			// patterns that are not a value of the config bits never match
+			auto &conn = db.connections.back();
+			int num_bits = conn.bits_end - conn.bits_begin;
+			chipdb_pattern_t pattern = { 0, atoi(strtok(nullptr, " \t\r\n")) };
+			int i = 0;
+			for (; tok[i] == '0' || tok[i] == '1'; i++)
+				pattern.value = (pattern.value << 1) | (tok[i] == '1');
+			if (tok[i] == 0 && i == num_bits && num_bits > 0) {
+				db.patterns.push_back(pattern);
+				conn.patterns_end = db.patterns.size();
+			}
 		}
 
-		if (mode == ".gbufin" || mode == ".gbufpin") {
-			std::vector<int> items;
-			while (tok != nullptr) {
-				items.push_back(atoi(tok));
-				tok = strtok(nullptr, " \t\r\n");
-			}
-			if (mode == ".gbufin")
-				gbufin.push_back(items);
-			else
-				gbufpin.push_back(items);
+		if (mode == ".gbufin") {
+			chipdb_gbufin_t gbuf;
+			gbuf.x = atoi(tok);
+			gbuf.y = atoi(strtok(nullptr, " \t\r\n"));
+			gbuf.glb = atoi(strtok(nullptr, " \t\r\n"));
+			db.gbufin.push_back(gbuf);
 		}
 
 		if (mode == ".logic_tile_bits" || mode == ".io_tile_bits" || mode == ".ramb_tile_bits" || mode == ".ramt_tile_bits") {
-			std::vector<std::pair<int, int>> items;
-			while (1) {
-				const char *s = strtok(nullptr, " \t\r\n");
-				if (s == nullptr)
-					break;
-				std::pair<int, int> item;
-				int rc = sscanf(s, "B%d[%d]", &item.first, &item.second);
+			chipdb_tile_bits_t tile_bits;
+			tile_bits.tile_type = mode == ".logic_tile_bits" ? TILE_LOGIC : mode == ".io_tile_bits" ? TILE_IO :
+					mode == ".ramb_tile_bits" ? TILE_RAMB : TILE_RAMT;
+			tile_bits.name = db.intern(tok);
+			tile_bits.bits_begin = db.bits.size();
+			while ((tok = strtok(nullptr, " \t\r\n")) != nullptr) {
+				int bit_row, bit_col, rc;
+				rc = sscanf(tok, "B%d[%d]", &bit_row, &bit_col);
 				assert(rc == 2);
-				items.push_back(item);
+				db.bits.push_back(chipdb_bit_t{int16_t(bit_row), int16_t(bit_col)});
 			}
-			if (mode == ".logic_tile_bits")
-				logic_tile_bits[tok] = items;
-			if (mode == ".io_tile_bits")
-				io_tile_bits[tok] = items;
-			if (mode == ".ramb_tile_bits")
-				ramb_tile_bits[tok] = items;
-			if (mode == ".ramt_tile_bits")
-				ramt_tile_bits[tok] = items;
+			tile_bits.bits_end = db.bits.size();
+			db.tile_bits.push_back(tile_bits);
 		}
+	}
 
-		if (mode == ".extra_bits") {
-			int b = atoi(strtok(nullptr, " \t\r\n"));
-			int x = atoi(strtok(nullptr, " \t\r\n"));
-			int y = atoi(strtok(nullptr, " \t\r\n"));
-			std::tuple<int, int, int> key(b, x, y);
-			if (extra_bits.count(key))
-				extrabitfunc.insert(tok);
-		}
+	db.net_segments.push_back(0);
+	for (auto &segs : net_segments) {
+		db.segments.insert(db.segments.end(), segs.begin(), segs.end());
+		db.net_segments.push_back(db.segments.size());
+	}
+}
+
+void write_chipdb_cache(const std::string &filename, const chipdb_t &db, uint64_t source_size, uint64_t source_hash)
+{
+	chipdb_header_t header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CHIPDB_CACHE_MAGIC, 8);
+	header.byte_order = CHIPDB_CACHE_BYTE_ORDER;
+	header.version = CHIPDB_CACHE_VERSION;
+	for (int i = 0; i < CHIPDB_NUM_SECTIONS; i++)
+		header.element_size[i] = chipdb_element_size[i];
+	header.source_size = source_size;
+	header.source_hash = source_hash;
+
+	uint64_t offset = sizeof(header);
+	for (int i = 0; i < CHIPDB_NUM_SECTIONS; i++) {
+		header.offset[i] = offset;
+		header.count[i] = db.count[i];
+		offset = (offset + db.count[i] * chipdb_element_size[i] + 7) & ~uint64_t(7);
+	}
+
+	// written under a temporary name so that no other run sees a partial file
+	std::string tmp_filename = stringf("%s.tmp%d", filename.c_str(), int(getpid()));
+	FILE *f = fopen(tmp_filename.c_str(), "wb");
+	if (f == nullptr) {
+		perror("Can't create chipdb cache file");
+		return;
+	}
+
+	static const char padding[8] = { };
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+	for (int i = 0; i < CHIPDB_NUM_SECTIONS && ok; i++) {
+		size_t len = db.count[i] * chipdb_element_size[i];
+		ok = fwrite(db.data[i], 1, len, f) == len && fwrite(padding, 1, -len & 7, f) == (-len & 7);
+	}
+
+	if (fclose(f) != 0 || !ok || rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+		perror("Can't write chipdb cache file");
+		remove(tmp_filename.c_str());
+	}
+}
+
+// check every index in the tables before load_chipdb() uses them: names,
+// table ranges, nets, and tiles and config bits against the current config
+bool valid_chipdb(const chipdb_t &db)
+{
+	uint64_t num_names = db.count[CHIPDB_NAME_OFFSETS];
+	uint64_t num_chars = db.count[CHIPDB_NAME_CHARS];
+	uint64_t num_bits = db.count[CHIPDB_BITS];
+	uint64_t num_patterns = db.count[CHIPDB_PATTERNS];
+
+	if (num_chars == 0 || db.table<char>(CHIPDB_NAME_CHARS)[num_chars-1] != 0)
+		return false;
+
+	auto name_offsets = db.table<uint32_t>(CHIPDB_NAME_OFFSETS);
+	for (uint64_t i = 0; i < num_names; i++)
+		if (name_offsets[i] >= num_chars)
+			return false;
+
+	auto net_segments = db.table<uint32_t>(CHIPDB_NET_SEGMENTS);
+	uint64_t num_nets = db.count[CHIPDB_NET_SEGMENTS];
+	if (num_nets == 0 || net_segments[0] != 0 || net_segments[num_nets-1] != db.count[CHIPDB_SEGMENTS])
+		return false;
+	num_nets--;
+	for (uint64_t i = 0; i < num_nets; i++)
+		if (net_segments[i] > net_segments[i+1])
+			return false;
+
+	auto segs = db.table<chipdb_segment_t>(CHIPDB_SEGMENTS);
+	for (uint64_t i = 0; i < db.count[CHIPDB_SEGMENTS]; i++)
+		if (segs[i].name < 0 || uint64_t(segs[i].name) >= num_names)
+			return false;
+
+	auto bits = db.table<chipdb_bit_t>(CHIPDB_BITS);
+	auto patterns = db.table<chipdb_pattern_t>(CHIPDB_PATTERNS);
+	auto connections = db.table<chipdb_connection_t>(CHIPDB_CONNECTIONS);
+
+	for (uint64_t i = 0; i < db.count[CHIPDB_CONNECTIONS]; i++)
+	{
+		auto &conn = connections[i];
+
+		if (conn.bits_begin > conn.bits_end || conn.bits_end > num_bits || conn.bits_end - conn.bits_begin > 32 ||
+				conn.patterns_begin > conn.patterns_end || conn.patterns_end > num_patterns ||
+				conn.net < 0 || uint64_t(conn.net) >= num_nets || (conn.routing != 0 && conn.routing != 1))
+			return false;
+
+		for (uint32_t k = conn.patterns_begin; k < conn.patterns_end; k++)
+			if (patterns[k].net < 0 || uint64_t(patterns[k].net) >= num_nets)
+				return false;
+
+		// the config bits are only read for entries with patterns
+		if (conn.patterns_begin == conn.patterns_end)
+			continue;
+
+		if (conn.x < 0 || conn.x >= int(config_bits.size()) || conn.y < 0 || conn.y >= int(config_bits[conn.x].size()))
+			return false;
+
+		auto &tile_bits = config_bits[conn.x][conn.y];
+		for (uint32_t k = conn.bits_begin; k < conn.bits_end; k++)
+			if (bits[k].row < 0 || bits[k].row >= tile_bits.height || bits[k].col < 0 || bits[k].col >= tile_bits.width)
+				return false;
+	}
+
+	auto pins = db.table<chipdb_pin_t>(CHIPDB_PINS);
+	for (uint64_t i = 0; i < db.count[CHIPDB_PINS]; i++)
+		if (pins[i].package < 0 || uint64_t(pins[i].package) >= num_names || pins[i].name < 0 || uint64_t(pins[i].name) >= num_names)
+			return false;
+
+	auto tile_bits = db.table<chipdb_tile_bits_t>(CHIPDB_TILE_BITS);
+	for (uint64_t i = 0; i < db.count[CHIPDB_TILE_BITS]; i++)
+		if (tile_bits[i].name < 0 || uint64_t(tile_bits[i].name) >= num_names ||
+				tile_bits[i].bits_begin > tile_bits[i].bits_end || tile_bits[i].bits_end > num_bits)
+			return false;
+
+	return true;
+}
+
+// map the tables of a cache file. false if the file is missing, damaged,
+// from another build or out of date.
+bool map_chipdb_cache(const file_data_t &file, chipdb_t &db, uint64_t source_size, uint64_t source_hash)
+{
+	chipdb_header_t header;
+	if (file.size < sizeof(header))
+		return false;
+
+	memcpy(&header, file.data, sizeof(header));
+	if (memcmp(header.magic, CHIPDB_CACHE_MAGIC, 8) || header.byte_order != CHIPDB_CACHE_BYTE_ORDER ||
+			header.version != CHIPDB_CACHE_VERSION || header.source_size != source_size || header.source_hash != source_hash)
+		return false;
+
+	for (int i = 0; i < CHIPDB_NUM_SECTIONS; i++) {
+		if (header.element_size[i] != chipdb_element_size[i] || header.offset[i] % 8 != 0 || header.offset[i] > file.size ||
+				header.count[i] > (file.size - header.offset[i]) / chipdb_element_size[i])
+			return false;
+		db.data[i] = file.data + header.offset[i];
+		db.count[i] = header.count[i];
 	}
 
-	fclose(fdb);
+	return valid_chipdb(db);
+}
 
-	// purge unused nets from memory
-	int max_net = net_to_segments.rbegin()->first;
-	for (int net = 0; net <= max_net; net++)
+// evaluate the connections of the chipdb for the current config
+void load_chipdb(const chipdb_t &db)
+{
+	auto pins = db.table<chipdb_pin_t>(CHIPDB_PINS);
+	for (uint64_t i = 0; i < db.count[CHIPDB_PINS]; i++)
+		if (db.name(pins[i].package) == selected_package) {
+			std::tuple<int, int, int> key(pins[i].x, pins[i].y, pins[i].z);
+			pin_pos[key] = db.name(pins[i].name);
+		}
+
+	auto connections = db.table<chipdb_connection_t>(CHIPDB_CONNECTIONS);
+	auto bits = db.table<chipdb_bit_t>(CHIPDB_BITS);
+	auto patterns = db.table<chipdb_pattern_t>(CHIPDB_PATTERNS);
+
+	for (uint64_t i = 0; i < db.count[CHIPDB_CONNECTIONS]; i++)
 	{
-		if (used_nets.count(net))
+		auto &conn = connections[i];
+		if (conn.patterns_begin == conn.patterns_end)
 			continue;
 
-		for (auto seg : net_to_segments[net])
-			segments.erase(seg);
-		net_to_segments.erase(net);
+		auto &tile_bits = config_bits[conn.x][conn.y];
+		uint32_t value = 0;
+		for (uint32_t k = conn.bits_begin; k < conn.bits_end; k++)
+			value = (value << 1) | tile_bits.get(bits[k].col, bits[k].row);
+
+		for (uint32_t k = conn.patterns_begin; k < conn.patterns_end; k++)
+		{
+			if (patterns[k].value != value)
+				continue;
 
-		for (auto other : net_buffers[net])
-			net_rbuffers[other].erase(net);
-		net_buffers.erase(net);
+			int current_net = conn.net, other_net = patterns[k].net;
 
-		for (auto other : net_rbuffers[net])
-			net_buffers[other].erase(net);
-		net_rbuffers.erase(net);
+			if (conn.routing) {
+				net_routing[current_net].insert(other_net);
+				net_routing[other_net].insert(current_net);
+			} else {
+				net_rbuffers[current_net].insert(other_net);
+				net_buffers[other_net].insert(current_net);
+			}
 
-		for (auto other : net_routing[net])
-			net_routing[other].erase(net);
-		net_routing.erase(net);
+			connection_pos[std::pair<int, int>(current_net, other_net)] =
+					connection_pos[std::pair<int, int>(other_net, current_net)] =
+					std::pair<int, int>(conn.x, conn.y);
+			used_nets.insert(current_net);
+			used_nets.insert(other_net);
+		}
+	}
+
+	// only the used nets are kept in memory
+	auto net_segments = db.table<uint32_t>(CHIPDB_NET_SEGMENTS);
+	auto segs = db.table<chipdb_segment_t>(CHIPDB_SEGMENTS);
+
+	for (int net : used_nets) {
+		if (net < 0 || uint64_t(net) + 1 >= db.count[CHIPDB_NET_SEGMENTS])
+			continue;
+		for (uint32_t k = net_segments[net]; k < net_segments[net+1]; k++) {
+			net_segment_t seg(segs[k].x, segs[k].y, net, db.name(segs[k].name));
+			net_to_segments[net].insert(seg);
+			segments.insert(seg);
+		}
+	}
+
+	auto tile_bits = db.table<chipdb_tile_bits_t>(CHIPDB_TILE_BITS);
+	for (uint64_t i = 0; i < db.count[CHIPDB_TILE_BITS]; i++)
+	{
+		std::vector<std::pair<int, int>> items;
+		for (uint32_t k = tile_bits[i].bits_begin; k < tile_bits[i].bits_end; k++)
+			items.push_back(std::pair<int, int>(bits[k].row, bits[k].col));
+
+		const char *name = db.name(tile_bits[i].name);
+		if (tile_bits[i].tile_type == TILE_LOGIC)
+			logic_tile_bits[name] = items;
+		if (tile_bits[i].tile_type == TILE_IO)
+			io_tile_bits[name] = items;
+		if (tile_bits[i].tile_type == TILE_RAMB)
+			ramb_tile_bits[name] = items;
+		if (tile_bits[i].tile_type == TILE_RAMT)
+			ramt_tile_bits[name] = items;
 	}
 
 	// create index
@@ -486,9 +897,10 @@ void read_chipdb()
 		x_y_name_net[key] = seg.net;
 	}
 
-	for (auto &it : gbufin)
+	auto gbufin = db.table<chipdb_gbufin_t>(CHIPDB_GBUFIN);
+	for (uint64_t i = 0; i < db.count[CHIPDB_GBUFIN]; i++)
 	{
-		int x = it[0], y = it[1], g = it[2];
+		int x = gbufin[i].x, y = gbufin[i].y, g = gbufin[i].glb;
 
 		std::tuple<int, int, std::string> fabout_x_y_name(x, y, "fabout");
 		std::tuple<int, int, std::string> glbl_x_y_name(x, y, stringf("glb_netwk_%d", g));
@@ -508,6 +920,60 @@ void read_chipdb()
 				connection_pos[std::pair<int, int>(fabout_net, glbl_net)] =
 				std::pair<int, int>(x, y);
 	}
+}
+
+void read_chipdb()
+{
+	char buffer[1024];
+
+	if (!chipdbfile.empty()) {
+		snprintf(buffer, 1024, "%s", chipdbfile.c_str());
+	} else
+	if (PREFIX[0] == '~' && PREFIX[1] == '/') {
+		std::string homedir;
+#ifdef _WIN32
+		if (getenv("USERPROFILE") != nullptr) {
+			homedir += getenv("USERPROFILE");
+		}
+		else {
+			if (getenv("HOMEDRIVE") != nullptr &&
+			    getenv("HOMEPATH") != nullptr) {
+				homedir += getenv("HOMEDRIVE");
+				homedir += getenv("HOMEPATH");
+			}
+		}
+#else
+		homedir += getenv("HOME");
+#endif
+		snprintf(buffer, 1024, "%s%s/share/" CHIPDB_SUBDIR "/chipdb-%s.txt", homedir.c_str(), PREFIX+1, config_device.c_str());
+	} else
+		snprintf(buffer, 1024, PREFIX "/share/" CHIPDB_SUBDIR "/chipdb-%s.txt", config_device.c_str());
+
+	file_data_t text;
+	if (!text.open(buffer)) {
+		perror("Can't open chipdb file");
+		exit(1);
+	}
+
+	uint64_t text_hash = chipdb_hash(text.data, text.size);
+
+	chipdb_t db;
+	chipdb_builder_t builder;
+	file_data_t cache;
+
+	if (chipdb_cache_file.empty() || !cache.open(chipdb_cache_file.c_str()) || !map_chipdb_cache(cache, db, text.size, text_hash))
+	{
+		compile_chipdb(reinterpret_cast<const char*>(text.data), text.size, builder);
+		builder.get(db);
+
+		if (!chipdb_cache_file.empty()) {
+			printf("// Writing chipdb cache file %s..\n", chipdb_cache_file.c_str());
+			fflush(stdout);
+			write_chipdb_cache(chipdb_cache_file, db, text.size, text_hash);
+		}
+	}
+
+	load_chipdb(db);
 
 	if (verbose)
 	{
@@ -1041,11 +1507,11 @@ std::string make_seg_pre_io(int x, int y, int z)
 
 	for (int i = 0; i < 6; i++) {
 		bitpos = io_tile_bits[stringf("IOB_%d.PINTYPE_%d", z, 5-i)][0];
-		pintype.push_back(config_bits[x][y][bitpos.first][bitpos.second] ? '1' : '0');
+		pintype.push_back(config_bits[x][y].get(bitpos.second, bitpos.first) ? '1' : '0');
 	}
 
 	bitpos = io_tile_bits["NegClk"][0];
-	char negclk = config_bits[x][y][bitpos.first][bitpos.second] ? '1' : '0';
+	char negclk = config_bits[x][y].get(bitpos.second, bitpos.first) ? '1' : '0';
 
 	netlist_cell_params[cell]["NEG_TRIGGER"] = stringf("1'b%c", negclk);
 	netlist_cell_params[cell]["PIN_TYPE"] = stringf("6'b%s", pintype.c_str());
@@ -1101,7 +1567,7 @@ std::string make_lc40(int x, int y, int z)
 	auto &lcbits_pos = logic_tile_bits[stringf("LC_%d", z)];
 
 	for (int i = 0; i < 20; i++)
-		lcbits[i] = config_bits[x][y][lcbits_pos[i].first][lcbits_pos[i].second] ? '1' : '0';
+		lcbits[i] = config_bits[x][y].get(lcbits_pos[i].second, lcbits_pos[i].first) ? '1' : '0';
 
 	// FIXME: fill in the '0'
 	netlist_cell_params[cell]["C_ON"] = stringf("1'b%c", lcbits[8]);
@@ -1119,8 +1585,8 @@ std::string make_lc40(int x, int y, int z)
 			auto co_cell = 1 < y ? make_lc40(x, y-1, 7) : std::string();
 			std::string n1, n2;
 
-			char cinit_1 = config_bits[x][y][1][49] ? '1' : '0';
-			char cinit_0 = config_bits[x][y][1][50] ? '1' : '0';
+			char cinit_1 = config_bits[x][y].get(49, 1) ? '1' : '0';
+			char cinit_0 = config_bits[x][y].get(50, 1) ? '1' : '0';
 
 			if (cinit_1 == '1') {
 				std::tuple<int, int, std::string> key(x, y-1, "lutff_7/cout");
@@ -1201,7 +1667,7 @@ std::string make_ram(int x, int y)
 bool dff_uses_clock(int x, int y, int z)
 {
 	auto bitpos = logic_tile_bits[stringf("LC_%d", z)][9];
-	return config_bits[x][y][bitpos.first][bitpos.second];
+	return config_bits[x][y].get(bitpos.second, bitpos.first);
 }
 
 void make_odrv(int x, int y, int src)
@@ -1259,7 +1725,7 @@ void make_inmux(int x, int y, int dst, std::string muxtype = "")
 		if (netlist_cell_types.count(cell))
 			continue;
 
-		netlist_cell_types[cell] = muxtype.empty() ? (config_tile_type[x][y] == "io" ? "IoInMux" : "InMux") : muxtype;
+		netlist_cell_types[cell] = muxtype.empty() ? (config_tile_type[x][y] == TILE_IO ? "IoInMux" : "InMux") : muxtype;
 		netlist_cell_ports[cell]["I"] = net_name(src);
 		netlist_cell_ports[cell]["O"] = net_name(dst);
 
@@ -1411,7 +1877,7 @@ void make_seg_cell(int net, const net_segment_t &seg)
 
 			for (int i = 0; i < 6; i++) {
 				bitpos = io_tile_bits[stringf("IOB_%d.PINTYPE_%d", z, 5-i)][0];
-				pintype.push_back(config_bits[seg.x][seg.y][bitpos.first][bitpos.second] ? '1' : '0');
+				pintype.push_back(config_bits[seg.x][seg.y].get(bitpos.second, bitpos.first) ? '1' : '0');
 			}
 
 			bool use_inclk = false;
@@ -1867,6 +2333,8 @@ void help(const char *cmd)
 	printf("\n");
 	printf("Usage: %s [options] input.asc\n", cmd);
 	printf("\n");
+	printf("    the input can also be a binary config file written by 'icepack -C'\n");
+	printf("\n");
 	printf("    -p <pcf_file>\n");
 	printf("    -P <chip_package>\n");
 	printf("        provide this two options for correct IO pin names\n");
@@ -1890,6 +2358,11 @@ void help(const char *cmd)
 	printf("    -C <chipdb-file>\n");
 	printf("        read chip description from the specified file\n");
 	printf("\n");
+	printf("    -B <chipdb-cache-file>\n");
+	printf("        use a precompiled binary chip description. the file is\n");
+	printf("        created from the chipdb file on the first run, and again\n");
+	printf("        whenever the chipdb file has changed\n");
+	printf("\n");
 	printf("    -m\n");
 	printf("        enable max_span_hack for conservative timing estimates\n");
 	printf("\n");
@@ -1924,7 +2397,7 @@ int main(int argc, char **argv)
 	std::vector<std::string> print_timing_nets;
 
 	int opt;
-	while ((opt = getopt(argc, argv, "p:P:g:o:r:j:d:mitT:Nvc:C:")) != -1)
+	while ((opt = getopt(argc, argv, "p:P:g:o:r:j:d:mitT:Nvc:C:B:")) != -1)
 	{
 		switch (opt)
 		{
@@ -1988,6 +2461,9 @@ int main(int argc, char **argv)
 		case 'C':
 			chipdbfile = optarg;
 			break;
+		case 'B':
+			chipdb_cache_file = optarg;
+			break;
 		case 'v':
 			verbose = true;
 			break;
@@ -1997,7 +2473,7 @@ int main(int argc, char **argv)
 	}
 
 	if (optind+1 == argc) {
-		fin = fopen(argv[optind], "r");
+		fin = fopen(argv[optind], "rb");
 		if (fin == nullptr) {
 			perror("Can't open input file");
 			exit(1);
@@ -2005,9 +2481,19 @@ int main(int argc, char **argv)
 	} else
 		help(argv[0]);
 
-	printf("// Reading input .asc file..\n");
-	fflush(stdout);
-	read_config();
+	char magic[8];
+	size_t magic_len = fread(magic, 1, sizeof(magic), fin);
+	rewind(fin);
+
+	if (FpgaConfig::is_binary(magic, magic_len)) {
+		printf("// Reading input binary config file..\n");
+		fflush(stdout);
+		read_config_binary();
+	} else {
+		printf("// Reading input .asc file..\n");
+		fflush(stdout);
+		read_config();
+	}
 
 	if (device_type.empty()) {
 		device_type = "lp" + config_device;
@@ -2050,9 +2536,7 @@ device_chip_mismatch:
 	for (int x = 0; x < int(config_tile_type.size()); x++)
 	for (int y = 0; y < int(config_tile_type[x].size()); y++)
 	{
-		auto const &tile_type = config_tile_type[x][y];
-
-		if (tile_type == "ramb")
+		if (config_tile_type[x][y] == TILE_RAMB)
 		{
 			bool cascade_cbits[4] = {false, false, false, false};
 			bool &cascade_cbit_4 = cascade_cbits[0];
@@ -2065,11 +2549,11 @@ device_chip_mismatch:
 				std::string cbit_name = stringf("RamCascade.CBIT_%d", i+4);
 				if (ramb_tile_bits.count(cbit_name)) {
 					bitpos = ramb_tile_bits.at(cbit_name)[0];
-					cascade_cbits[i] = config_bits[x][y][bitpos.first][bitpos.second];
+					cascade_cbits[i] = config_bits[x][y].get(bitpos.second, bitpos.first);
 				}
 				if (ramt_tile_bits.count(cbit_name)) {
 					bitpos = ramt_tile_bits.at(cbit_name)[0];
-					cascade_cbits[i] = config_bits[x][y+1][bitpos.first][bitpos.second];
+					cascade_cbits[i] = config_bits[x][y+1].get(bitpos.second, bitpos.first);
 				}
 			}
 